@@ -7,17 +7,37 @@
  * HTU21 sensor.
  *
  * The API:
- *  - Provides ready-to-use physical values (°C, %RH)
+ *  - Provides ready-to-use physical values in fixed point
+ *    (0.01 °C, 0.01 %RH), computed without floating point
  *  - Hides low-level I2C transactions and timing requirements
+ *  - Validates every result with the sensor's CRC-8 and retries
+ *    corrupted or failed reads a bounded number of times
  *  - Caches the last successfully read values
  *  - Can be used directly by application-level code
  *
  * This module depends on an external I2C master driver, but does not
  * access hardware registers directly.
  *
+ * Measurements use the sensor's no-hold-master mode. The non-blocking
+ * pair htu21_trigger() / htu21_poll() starts a conversion and collects
+ * the result later, so the caller can keep working while the sensor
+ * converts. htu21_read_temperature_c100() and htu21_read_humidity_c100()
+ * are blocking wrappers around the same pair; they and htu21_sample()
+ * are only built with HTU21_BLOCKING_API=1.
+ *
+ * htu21_sample() / htu21_sample_step() run both conversions back to
+ * back and return one consistent record that also carries the
+ * temperature-compensated RH.
+ *
+ * Measurement resolution is set through the sensor's user register
+ * (htu21_set_resolution(), built with HTU21_USER_REG_API=1; otherwise
+ * the power-on resolution is kept); all waits use the conversion time
+ * of the selected resolution (htu21_conv_time_ms()).
+ *
+ * The float functions (htu21_read_temperature() etc.) are only built
+ * with HTU21_FLOAT_API=1 so that firmware without them does not pull in
+ * the floating-point library.
  *
- * @note Sensor CRC byte is currently ignored.
- * @note Blocking delays are used during measurement.
  *
  * @date 2026-02-04
  * 
@@ -29,12 +49,349 @@
 
 #include "i2c_driver.h"
 
+/* htu21_poll(): conversion still running */
+#define HTU21_BUSY 1
+
+/* Fixed-point functions: no valid measurement */
+#define HTU21_INVALID ((int16_t)-32768)
+
+/* Extra conversions after a CRC or I2C error before a read fails */
+#ifndef HTU21_RETRIES
+#define HTU21_RETRIES 2
+#endif
+
+/* CRC-8 implementation: 1 = 16-byte nibble table, 0 = bitwise loop */
+#ifndef HTU21_CRC_TABLE
+#define HTU21_CRC_TABLE 1
+#endif
+
+/* Build the float wrappers around the fixed-point API */
+#ifndef HTU21_FLOAT_API
+#define HTU21_FLOAT_API 0
+#endif
+
+/* Build the blocking reads (needed by the float wrappers) */
+#ifndef HTU21_BLOCKING_API
+#define HTU21_BLOCKING_API HTU21_FLOAT_API
+#endif
+
+/* 1 = count CRC, I2C and timeout errors (htu21_get_errors()) */
+#ifndef HTU21_STATS
+#define HTU21_STATS 1
+#endif
+
+/*
+ * Build the user register access and htu21_set_resolution().
+ * Off by default: main.c samples at the power-on resolution (RH12/T14)
+ * and never switches profiles, so the code would be linked unused.
+ * Turn it on together with its caller, e.g. a fast sampling mode.
+ */
+#ifndef HTU21_USER_REG_API
+#define HTU21_USER_REG_API 0
+#endif
+
+#if HTU21_FLOAT_API && !HTU21_BLOCKING_API
+#error "htu21: HTU21_FLOAT_API needs HTU21_BLOCKING_API"
+#endif
+
+/**
+ * @brief Measurement kinds supported by the sensor.
+ */
+typedef enum {
+    HTU21_MEAS_TEMP = 0,  /**< Temperature */
+    HTU21_MEAS_HUM  = 1   /**< Relative humidity */
+} htu21_meas_t;
+
+/**
+ * @brief Measurement resolutions (user register bits 7 and 0).
+ *
+ * Maximum conversion times from the datasheet:
+ *
+ * | Resolution          | RH    | T     |
+ * |---------------------|-------|-------|
+ * | HTU21_RES_RH12_T14  | 16 ms | 50 ms |
+ * | HTU21_RES_RH11_T11  |  8 ms |  7 ms |
+ * | HTU21_RES_RH10_T13  |  5 ms | 25 ms |
+ * | HTU21_RES_RH8_T12   |  3 ms | 13 ms |
+ */
+typedef enum {
+    HTU21_RES_RH12_T14 = 0x00,  /**< Power-on default */
+    HTU21_RES_RH8_T12  = 0x01,
+    HTU21_RES_RH10_T13 = 0x80,
+    HTU21_RES_RH11_T11 = 0x81
+} htu21_res_t;
+
+/**
+ * @brief One temperature/humidity snapshot (see htu21_sample()).
+ */
+typedef struct {
+    uint16_t seq;             /**< Record number, increments per sample */
+    uint32_t t_ms;            /**< millis() when the record was completed */
+    int16_t  temp_c100;       /**< Temperature, 0.01 °C */
+    int16_t  hum_c100;        /**< Relative humidity as measured, 0.01 %RH */
+    int16_t  hum_comp_c100;   /**< RH compensated to 25 °C, 0.01 %RH */
+} htu21_sample_t;
+
+/* Profile for fast humidity sampling (e.g. during ventilation) */
+#define HTU21_RES_FAST    HTU21_RES_RH8_T12
+/* Full-precision profile */
+#define HTU21_RES_DEFAULT HTU21_RES_RH12_T14
+
+/**
+ * @brief Error counters since start-up or htu21_reset_errors()
+ *        (only with HTU21_STATS = 1).
+ *
+ * A read that is retried and then succeeds still counts its errors, so
+ * the counters show link quality even when no value was lost.
+ */
+typedef struct {
+    uint16_t crc;      /**< Results rejected by the CRC check */
+    uint16_t i2c;      /**< Failed trigger or read transactions */
+    uint16_t timeout;  /**< Conversions the sensor never answered */
+    uint16_t retries;  /**< Conversions re-triggered after an error */
+} htu21_errors_t;
+
+/**
+ * @brief Starts a measurement without waiting for it.
+ *
+ * Sends the no-hold-master trigger command for the selected measurement
+ * and returns immediately. The result is collected with htu21_poll()
+ * once the conversion time (htu21_conv_time_ms()) has passed, or
+ * earlier by polling.
+ *
+ * @param[in] meas  Measurement to start.
+ *
+ * @retval 0   Conversion started.
+ * @retval -1  I2C communication error.
+ *
+ * @note Starting a new measurement discards a pending one.
+ */
+int htu21_trigger(htu21_meas_t meas);
+
+/**
+ * @brief Collects the result of the measurement started by htu21_trigger().
+ *
+ * Addresses the sensor for reading. While converting, the sensor does
+ * not acknowledge its address and the function returns ::HTU21_BUSY
+ * without blocking. Once the result is read its CRC is checked, then it
+ * is converted and stored as the last temperature or humidity value.
+ *
+ * On a CRC mismatch or I2C error the same conversion is triggered again
+ * (up to HTU21_RETRIES times) and ::HTU21_BUSY is returned; the cached
+ * value is never updated from a rejected frame.
+ *
+ * @retval 0           Result read; see htu21_last_temperature_c100() /
+ *                     htu21_last_humidity_c100().
+ * @retval HTU21_BUSY  Conversion still in progress, poll again later.
+ * @retval -1          No measurement pending, or CRC / I2C error after
+ *                     all retries.
+ */
+int htu21_poll(void);
+
+/**
+ * @brief Applies the sensor's RH temperature coefficient.
+ *
+ * RH_comp = RH + (T - 25 °C) * 0.15 %RH/°C, clamped to 0 ... 100 %RH.
+ *
+ * @param[in] t_c100   Temperature in 0.01 °C.
+ * @param[in] rh_c100  Measured relative humidity in 0.01 %RH.
+ *
+ * @retval int16_t        Compensated relative humidity in 0.01 %RH.
+ * @retval HTU21_INVALID  An input is HTU21_INVALID.
+ *
+ * @note The datasheet specifies the coefficient for 0 ... 80 °C.
+ */
+int16_t htu21_hum_comp_c100(int16_t t_c100, int16_t rh_c100);
+
+/**
+ * @brief Advances the sample pipeline without blocking.
+ *
+ * The first call triggers the temperature conversion. Following calls
+ * poll it; as soon as the temperature is read, the humidity conversion
+ * is triggered in the same call. When humidity is read the compensated
+ * RH is calculated and the record is written to @p out.
+ *
+ * @param[out] out  Record, written only when 0 is returned.
+ *
+ * @retval 0           Record complete, the next call starts a new sample.
+ * @retval HTU21_BUSY  Conversion in progress, call again later.
+ * @retval -1          CRC / I2C error after all retries, or (with the
+ *                     system tick running) no answer within twice the
+ *                     conversion time; the pipeline is reset.
+ *
+ * @note With the system tick running (systick.h), calls made before
+ *       the conversion time has passed return HTU21_BUSY without any
+ *       I2C traffic.
+ * @note Do not mix with htu21_trigger() / htu21_poll() while a sample is
+ *       in progress.
+ */
+int htu21_sample_step(htu21_sample_t *out);
+
+#if HTU21_BLOCKING_API
+/**
+ * @brief Takes one complete sample, blocking until it is done.
+ *
+ * Runs htu21_sample_step() to completion, waiting the conversion time
+ * of each measurement at the current resolution.
+ *
+ * @param[out] out  Record.
+ *
+ * @retval 0   Success.
+ * @retval -1  CRC / I2C error or timeout.
+ */
+int htu21_sample(htu21_sample_t *out);
+#endif
+
+#if HTU21_USER_REG_API
+/**
+ * @brief Reads the sensor's user register.
+ *
+ * @param[out] reg  Register value.
+ *
+ * @retval 0   Success.
+ * @retval -1  I2C communication error.
+ */
+int htu21_read_user_reg(uint8_t *reg);
+
+/**
+ * @brief Writes the sensor's user register.
+ *
+ * @param[in] reg  New register value.
+ *
+ * @retval 0   Success.
+ * @retval -1  I2C communication error.
+ *
+ * @note Reserved bits must keep the value read from the sensor; use
+ *       htu21_set_resolution() to change only the resolution.
+ * @note Does not update the conversion time used by the driver.
+ */
+int htu21_write_user_reg(uint8_t reg);
+
+/**
+ * @brief Selects the measurement resolution.
+ *
+ * Read-modify-writes the user register so that the heater, OTP and
+ * reserved bits are preserved, and switches the driver's conversion
+ * waits to the new resolution.
+ *
+ * @param[in] res  Resolution, e.g. ::HTU21_RES_FAST.
+ *
+ * @retval 0   Success.
+ * @retval -1  I2C communication error; the resolution is unchanged.
+ *
+ * @note The sensor returns to ::HTU21_RES_RH12_T14 after power-up or
+ *       soft reset.
+ */
+int htu21_set_resolution(htu21_res_t res);
+
+/**
+ * @brief Returns the resolution last set with htu21_set_resolution().
+ *
+ * @retval htu21_res_t  Current resolution.
+ */
+htu21_res_t htu21_get_resolution(void);
+#endif
+
+/**
+ * @brief Returns the maximum conversion time at the current resolution.
+ *
+ * @param[in] meas  Measurement kind.
+ *
+ * @retval uint8_t  Conversion time in milliseconds.
+ */
+uint8_t htu21_conv_time_ms(htu21_meas_t meas);
+
+#if HTU21_STATS
+/**
+ * @brief Copies the error counters.
+ *
+ * @param[out] out  Destination for the counters.
+ */
+void htu21_get_errors(htu21_errors_t *out);
+
+/**
+ * @brief Clears the error counters.
+ */
+void htu21_reset_errors(void);
+#endif
+
+/**
+ * @brief Converts a raw temperature reading to hundredths of a degree.
+ *
+ * Evaluates the datasheet formula with one 16x16 multiplication and a
+ * shift, rounded to the nearest 0.01 °C.
+ *
+ * @param[in] raw  16-bit sensor word (status bits are ignored).
+ *
+ * @retval int16_t  Temperature in 0.01 °C (-4685 ... 12887).
+ *
+ * @note Temperature [0.01 °C] = -4685 + 17572 * raw / 2^16
+ */
+int16_t htu21_temp_c100(uint16_t raw);
+
+/**
+ * @brief Converts a raw humidity reading to hundredths of a percent.
+ *
+ * @param[in] raw  16-bit sensor word (status bits are ignored).
+ *
+ * @retval int16_t  Relative humidity in 0.01 %RH (-600 ... 11900).
+ *
+ * @note Humidity [0.01 %RH] = -600 + 12500 * raw / 2^16
+ * @note The value is not clamped to 0 ... 100 %RH.
+ */
+int16_t htu21_hum_c100(uint16_t raw);
+
+#if HTU21_BLOCKING_API
+/**
+ * @brief Reads the temperature from the HTU21 sensor.
+ *
+ * Triggers a temperature conversion, polls the sensor until it is
+ * finished and converts the result with htu21_temp_c100().
+ *
+ * @retval int16_t        Measured temperature in 0.01 °C.
+ * @retval HTU21_INVALID  Error occurred during I2C communication.
+ */
+int16_t htu21_read_temperature_c100(void);
+
+/**
+ * @brief Reads the relative humidity from the HTU21 sensor.
+ *
+ * Triggers a humidity conversion, polls the sensor until it is
+ * finished and converts the result with htu21_hum_c100().
+ *
+ * @retval int16_t        Measured relative humidity in 0.01 %RH.
+ * @retval HTU21_INVALID  Error occurred during I2C communication.
+ */
+int16_t htu21_read_humidity_c100(void);
+#endif
+
+/**
+ * @brief Returns the last successfully read temperature.
+ *
+ * Does not perform a new measurement.
+ *
+ * @retval int16_t        Last measured temperature in 0.01 °C.
+ * @retval HTU21_INVALID  No temperature has been read yet.
+ */
+int16_t htu21_last_temperature_c100(void);
+
+/**
+ * @brief Returns the last successfully read relative humidity.
+ *
+ * Does not perform a new measurement.
+ *
+ * @retval int16_t        Last measured relative humidity in 0.01 %RH.
+ * @retval HTU21_INVALID  No humidity has been read yet.
+ */
+int16_t htu21_last_humidity_c100(void);
+
+#if HTU21_FLOAT_API
 /**
  * @brief Reads the temperature from the HTU21 sensor.
  *
- * This function performs a temperature measurement by sending the
- * appropriate command to the HTU21 sensor and reading the resulting
- * 16-bit raw value. The raw value is then converted to degrees Celsius
+ * This function performs a temperature measurement by triggering a
+ * conversion, polling the HTU21 sensor until it is finished and reading
+ * the resulting 16-bit raw value. The raw value is then converted to degrees Celsius
  * according to the sensor's datasheet formula.
  *
  * @retval float  Measured temperature in °C.
@@ -42,16 +399,16 @@
  *
  * @note The conversion formula is:
  *       Temperature [°C] = -46.85 + 175.72 * (raw / 2^16)
- * @note The last successfully read temperature is stored in `last_temp`.
+ * @note Wrapper around htu21_read_temperature_c100().
  */
 float htu21_read_temperature(void);
 
 /**
  * @brief Reads the relative humidity from the HTU21 sensor.
  *
- * This function performs a humidity measurement by sending the
- * appropriate command to the HTU21 sensor and reading the resulting
- * 16-bit raw value. The raw value is then converted to relative
+ * This function performs a humidity measurement by triggering a
+ * conversion, polling the HTU21 sensor until it is finished and reading
+ * the resulting 16-bit raw value. The raw value is then converted to relative
  * humidity (%) according to the sensor's datasheet formula.
  *
  * @retval float  Measured relative humidity in %RH.
@@ -59,7 +416,7 @@ float htu21_read_temperature(void);
  *
  * @note The conversion formula is:
  *       Humidity [%RH] = -6 + 125 * (raw / 2^16)
- * @note The last successfully read humidity value is stored in `last_hum`.
+ * @note Wrapper around htu21_read_humidity_c100().
  */
 float htu21_read_humidity(void);
 
@@ -71,7 +428,8 @@ float htu21_read_humidity(void);
  *
  * @retval float  Last measured temperature in °C.
  *
- * @note The value is updated each time `htu21_read_temperature()` is called.
+ * @note The value is updated each time a temperature measurement
+ *       completes (`htu21_read_temperature()` or `htu21_poll()`).
  */
 float htu21_last_temperature(void);
 
@@ -83,8 +441,10 @@ float htu21_last_temperature(void);
  *
  * @retval float  Last measured relative humidity in %RH.
  *
- * @note The value is updated each time `htu21_read_humidity()` is called.
+ * @note The value is updated each time a humidity measurement
+ *       completes (`htu21_read_humidity()` or `htu21_poll()`).
  */
 float htu21_last_humidity(void);
+#endif
 
 #endif
\ No newline at end of file
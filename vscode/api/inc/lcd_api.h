@@ -8,9 +8,29 @@
  * The API provides convenient functions for:
  * - LCD initialization
  * - Sending commands and data
- * - Printing strings, integers, and floating-point numbers
+ * - Printing strings, integers, and fixed-point numbers
  * - Cursor positioning and display clearing
  *
+ * Strings are streamed: the nibble/EN sequences of a whole row are packed
+ * into a single I2C transaction instead of one transaction per character.
+ *
+ * The drawing functions (`lcd_put_cur()`, `lcd_send_string()`,
+ * `lcd_send_char()`, `lcd_send_int()`, `lcd_send_fixed()`, `lcd_send_float()`, `lcd_clear()`) do not touch the
+ * bus: they draw into a RAM shadow of the 16x2 DDRAM. `lcd_flush()` then
+ * sends only the runs of characters that changed since the last flush.
+ * `lcd_send_cmd()`, `lcd_send_data()` and `lcd_write()` still go straight
+ * to the display and bypass the shadow.
+ *
+ * `lcd_send_float()` is only built with LCD_FLOAT_API=1, so that firmware
+ * without it does not pull in the floating-point routines: the Cosmic
+ * float helpers (c_fmul, c_ftol, c_okadd, ...) took 829 bytes of the
+ * baseline main.elf, on top of 121 bytes for the function itself.
+ * lcd_send_fixed() gives the same output from a scaled integer.
+ *
+ * Busy-flag reads are built with LCD_BUSY_FLAG=1 (default); with 0, or
+ * when the adapter cannot read the flag, clear and home wait the fixed
+ * 2 ms.
+ *
  * Low-level I2C communication is handled by the i2c_driver module.
  *
  * @note LCD operates in 4-bit mode through PCF8574.
@@ -25,6 +45,16 @@
 
 #include <stdint.h>
 
+/* 1 = wait for clear/home on the busy flag, falling back to the fixed delay; 0 = fixed delay only */
+#ifndef LCD_BUSY_FLAG
+#define LCD_BUSY_FLAG 1
+#endif
+
+/* Build lcd_send_float() */
+#ifndef LCD_FLOAT_API
+#define LCD_FLOAT_API 0
+#endif
+
 /**
  * @brief Sends a command byte to the LCD via PCF8574 I2C I/O expander.
  *
@@ -35,10 +65,13 @@
  * The PCF8574 output pins are used to control the LCD signals:
  * - RS = 0 (command mode)
  * - EN is toggled to latch each nibble
- * - Backlight output is kept enabled
+ * - Backlight output is kept as set by `lcd_backlight()`
  *
  * @param[in] cmd  LCD command byte to be sent.
  *
+ * @note Clear (0x01) and home (0x02) wait until the controller is
+ *       ready: by polling the busy flag, or for 2 ms if it cannot be
+ *       read. Other commands return right after the I2C transfer.
  * @note This function assumes a PCF8574-based LCD adapter
  *       with I2C address 0x27.
  */
@@ -54,7 +87,7 @@ void lcd_send_cmd(char cmd);
  * The PCF8574 output pins are used to control the LCD signals:
  * - RS = 1 (data mode)
  * - EN is toggled to latch each nibble
- * - Backlight output is kept enabled
+ * - Backlight output is kept as set by `lcd_backlight()`
  *
  * @param[in] data  The data byte (character) to send to the LCD.
  *
@@ -63,6 +96,21 @@ void lcd_send_cmd(char cmd);
  */
 void lcd_send_data (char data);
 
+/**
+ * @brief Writes a run of characters to the LCD in one I2C transaction.
+ *
+ * The nibble/EN sequences of up to LCD_COLS characters are packed into
+ * one buffer and sent with a single `i2c_master_transmit()` call, so a
+ * full 16-character row costs one START/address/STOP framing instead
+ * of sixteen. Longer runs are split into LCD_COLS-sized chunks.
+ *
+ * @param[in] buf  Characters to write (not necessarily null-terminated).
+ * @param[in] len  Number of characters.
+ *
+ * @note Characters are written at the current cursor position.
+ */
+void lcd_write(const char *buf, uint8_t len);
+
 /**
  * @brief Initializes the LCD via PCF8574 I2C I/O expander.
  *
@@ -74,90 +122,152 @@ void lcd_send_data (char data);
  * - Display ON, cursor OFF, blink OFF
  * - Entry mode set (increment, no shift)
  *
- * Timing delays are applied according to LCD power-up requirements.
+ * The power-up reset (three 0x3 nibbles and the switch to 4-bit mode)
+ * uses the fixed delays of the datasheet, since the busy flag is not
+ * readable until then. With LCD_BUSY_FLAG=1 the busy flag is probed
+ * afterwards; if it can be read, clear/home commands return as soon as
+ * the controller is ready instead of after a fixed 2 ms wait.
  *
  * @note This function assumes the LCD is connected through a
  *       PCF8574 I2C adapter at address 0x27.
- * @note Backlight is enabled by default in the command/data functions.
+ * @note The backlight is on after start-up (see `lcd_backlight()`).
  */
 void lcd_init(void);
 
 /**
- * @brief Sends a null-terminated string to the LCD via PCF8574.
+ * @brief Draws a null-terminated string into the shadow framebuffer.
  *
- * This function transmits a sequence of characters to the LCD by
- * repeatedly calling `lcd_send_data()`. The string must be
- * null-terminated.
+ * The characters are stored at the shadow cursor position, which
+ * advances by one column per character. Only cells whose content
+ * changes are marked for the next `lcd_flush()`.
  *
  * @param[in] str  Pointer to the null-terminated string to display.
  *
- * @note Each character is sent in 4-bit mode through the PCF8574 I2C
- *       expander. Backlight is assumed to be enabled.
- * @note The string will be displayed starting from the current cursor
- *       position; it does not automatically wrap lines.
+ * @note The string does not wrap; characters past the last column
+ *       are dropped.
  */
 void lcd_send_string (char *str);
 
 /**
- * @brief Sets the cursor position on the LCD.
+ * @brief Draws one character into the shadow framebuffer.
  *
- * This function moves the LCD cursor to the specified row and column.
- * The position is converted into the corresponding DDRAM address
- * and sent as a command via `lcd_send_cmd()`.
+ * Like `lcd_send_string()` for a single character; also accepts codes
+ * that cannot appear in a string, e.g. CGRAM glyph 0.
+ *
+ * @param[in] c  Character code.
+ */
+void lcd_send_char(char c);
+
+/**
+ * @brief Sets the shadow cursor position.
+ *
+ * Subsequent drawing functions write into the shadow framebuffer
+ * starting at this row and column. No command is sent to the LCD;
+ * `lcd_flush()` positions the hardware cursor itself.
  *
  * @param[in] row  Row index (0 or 1 for 2-line display).
  * @param[in] col  Column index (0–15 for 16x2 LCD).
  *
- * @note The function assumes a standard 16x2 LCD connected through
- *       a PCF8574 I2C expander at address 0x27.
  * @note If the specified row exceeds the number of rows, the function
  *       defaults to the first row.
  */
 void lcd_put_cur(int row, int col);
 
+/**
+ * @brief Sends the changed parts of the shadow framebuffer to the LCD.
+ *
+ * Each run of consecutive changed characters costs one cursor command
+ * and one streamed `lcd_write()`; unchanged characters are not sent.
+ *
+ * @return Number of character cells skipped because they were
+ *         unchanged (0 ... LCD_ROWS * LCD_COLS).
+ */
+uint8_t lcd_flush(void);
+
+/**
+ * @brief Marks the whole shadow framebuffer as changed.
+ *
+ * The next `lcd_flush()` redraws every cell. Use after writing to the
+ * display directly (e.g. with `lcd_send_data()`).
+ */
+void lcd_invalidate(void);
+
 /**
  * @brief Sends an integer number to the LCD as a string.
  *
- * This function converts a non-negative integer into a decimal
- * string representation and sends it to the LCD using
- * `lcd_send_string()`.
+ * This function converts an integer into decimal digits with
+ * `fmt_fixed()`, which draws them straight into the shadow framebuffer.
  *
- * @param[in] num  Integer number to display (assumes non-negative).
+ * @param[in] num  Integer number to display; negative numbers get a '-'.
  *
- * @note The function supports only non-negative integers.
- * @note Maximum number of digits is 10 (fits in `buf[10]`).
  * @note The number is displayed starting from the current cursor
  *       position; it does not handle line wrapping.
  */
 void lcd_send_int(int num);
 
 /**
- * @brief Clears the LCD display and resets the cursor to home.
+ * @brief Sends a fixed-point number to the LCD.
  *
- * This function sends the clear display command to the LCD via
- * `lcd_send_cmd()`. After clearing, the cursor is set to the
- * home position (row 0, column 0).
+ * Draws value / 10^decimals, right-aligned in @p width columns, e.g.
+ * `lcd_send_fixed(2345, 2, 6)` draws " 23.45". A fixed width keeps the
+ * text of changing values in place, so `lcd_flush()` only rewrites the
+ * digits that changed.
+ *
+ * @param[in] value     Scaled value, e.g. temperature in 0.01 °C.
+ * @param[in] decimals  Digits after the decimal point.
+ * @param[in] width     Field width in columns (0 = as needed, at most LCD_COLS).
+ *
+ * @note No floating point is used.
+ */
+void lcd_send_fixed(int32_t value, uint8_t decimals, uint8_t width);
+
+/**
+ * @brief Clears the shadow framebuffer and resets the cursor to home.
  *
- * @note A delay of 2 ms is applied after the command to allow the
- *       LCD to complete the clear operation.
- * @note This function uses a PCF8574 I2C GPIO expander at address 0x27.
+ * All cells are set to spaces and the shadow cursor is moved to
+ * row 0, column 0. Nothing is sent to the LCD: on the next
+ * `lcd_flush()` only cells that were not already blank are rewritten,
+ * so clearing and redrawing a screen every frame does not flicker.
  */
 void lcd_clear(void);
 
+#if LCD_FLOAT_API
 /**
  * @brief Sends a floating-point number to the LCD as a string.
  *
- * This function converts a floating-point number into a decimal string
- * with one digit after the decimal point and sends it to the LCD
- * using `lcd_send_string()`.
+ * This function rounds a floating-point number to tenths and formats
+ * it with `fmt_fixed()`, which draws it straight into the shadow
+ * framebuffer.
  *
  * @param[in] num  Floating-point number to display.
  *
  * @note The function rounds the number to one decimal place.
  * @note Negative numbers are handled, with a '-' printed before the number.
- * @note Maximum displayable integer part is 3 digits (up to 999.9).
+ * @note Prefer `lcd_send_fixed()`, which needs no floating point.
  * @note The number is displayed starting from the current cursor position.
  */
 void lcd_send_float(float num);
+#endif
+
+/**
+ * @brief Reports whether commands wait on the busy flag.
+ *
+ * @retval 1  Busy-flag reads through the PCF8574 work.
+ * @retval 0  Not initialized yet, built with LCD_BUSY_FLAG=0, or a read
+ *            failed or timed out (for example RW is tied to GND on the
+ *            adapter); fixed delays are used instead.
+ */
+uint8_t lcd_busy_flag_ok(void);
+
+/**
+ * @brief Switches the LCD backlight on or off.
+ *
+ * The backlight is the PCF8574 output P3; its state is sent with every
+ * later expander write. Changing it costs one I2C byte, calling it with
+ * the current state costs nothing.
+ *
+ * @param[in] on  1 = on, 0 = off.
+ */
+void lcd_backlight(uint8_t on);
 
 #endif
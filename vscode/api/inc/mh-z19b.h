@@ -3,7 +3,93 @@
 
 #include <stdint.h>
 
-void MHZ19_PWM_Init(void);
-uint16_t MHZ19_PWM_GetPPM(void);
+/* Sensor interface backends */
+#define MHZ19_BACKEND_EXTI 0   /* PWM, EXTI ISR reads the timer (software timestamps); add exti_driver.o to temp.lkf */
+#define MHZ19_BACKEND_IC   1   /* PWM, TIM2 input capture, both edges latched in hardware */
+#define MHZ19_BACKEND_UART 2   /* UART1 9600 8N1, command 0x86 (mh-z19b_uart.c); build with UART1_RX_IRQ=1, add uart_driver.o to temp.lkf */
+
+/* Selected backend; PWM backends use PD3 (TIM2_CH2), UART uses UART1 */
+#ifndef MHZ19_BACKEND
+#define MHZ19_BACKEND MHZ19_BACKEND_IC
+#endif
+
+/* Capture timebase resolution (TIM2 at 4 us in every clock profile, clock.h) */
+#define MHZ19_TICK_US 4UL
+
+/* Readings in the median filter of MHZ19_GetPPM(); 0 = no median and no EMA */
+#ifndef MHZ19_FILTER_LEN
+#define MHZ19_FILTER_LEN 5
+#endif
+
+/* Converts milliseconds to capture ticks */
+#define MHZ19_MS_TO_TICKS(ms) ((uint32_t)(ms) * 1000UL / MHZ19_TICK_US)
+
+/* Sensor UART speed (MHZ19_BACKEND_UART) */
+#define MHZ19_UART_BAUD 9600UL
+
+/* Longest wait for the reply to a read request, ms (MHZ19_BACKEND_UART) */
+#define MHZ19_REPLY_TIMEOUT_MS 100u
+
+/* Measurement ranges for MHZ19_SetRange() */
+#define MHZ19_RANGE_2000 2000u
+#define MHZ19_RANGE_5000 5000u
+
+/* Names used before the UART backend existed */
+#define MHZ19_PWM_Init   MHZ19_Init
+#define MHZ19_PWM_GetPPM MHZ19_GetPPM
+
+void MHZ19_Init(void);
+
+/*
+ * CO2 concentration in ppm, 0 until the first valid reading.
+ *
+ * PWM backends: with MHZ19_FILTER_LEN > 0 each new validated cycle goes
+ * through a median of the last MHZ19_FILTER_LEN readings and an EMA
+ * (alpha 1/4), 5 by default; with 0 the reading of the last cycle is
+ * returned as is. Without a new cycle the previous output is returned.
+ *
+ * UART backend: returns the last value received with a valid checksum
+ * and sends the next read request (0x86); call it at the desired
+ * sampling period (not faster than every ~20 ms).
+ */
+uint16_t MHZ19_GetPPM(void);
+
+#if MHZ19_BACKEND == MHZ19_BACKEND_UART
+/*
+ * Automatic baseline correction on/off (command 0x79).
+ */
+void MHZ19_SetABC(uint8_t enable);
+
+/*
+ * Detection range in ppm, e.g. MHZ19_RANGE_5000 (command 0x99).
+ */
+void MHZ19_SetRange(uint16_t range_ppm);
+
+/*
+ * Number of received frames dropped for a bad checksum, framing error
+ * or overrun.
+ */
+uint16_t MHZ19_GetFrameErrors(void);
+
+/*
+ * Gives up a reply that did not arrive within MHZ19_REPLY_TIMEOUT_MS of
+ * its request: releases POWER_LOCK_UART (halt, clock scaling) and counts
+ * a timeout. Call it from the main loop; MHZ19_GetPPM() does the same
+ * for an unanswered previous request.
+ */
+void MHZ19_Poll(void);
+
+/*
+ * Number of read requests that got no reply in time.
+ */
+uint16_t MHZ19_GetTimeouts(void);
+#else
+/*
+ * Last validated PWM cycle: high time and period (high + low),
+ * in MHZ19_TICK_US ticks. Returns the validated-cycle counter,
+ * which changes with every new cycle.
+ */
+uint8_t MHZ19_PWM_GetTiming(uint32_t *high_ticks, uint32_t *period_ticks);
+#endif
 
 #endif
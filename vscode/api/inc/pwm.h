@@ -10,11 +10,13 @@
  *  - Generating periodic sound patterns (ON/OFF beeping)
  *  - Non-blocking operation via a simple state machine
  *
- * Timing is handled by calling Buzzer_Update() periodically
- * (typically every 1 ms).
+ * Timing is based on millis() (systick.h): Buzzer_Update() compares
+ * the time spent in the current ON/OFF phase, so it can be called at
+ * any rate; the phase edges are as accurate as the calling period.
  *
  * This module relies on the TIM1 PWM API and does not access
- * hardware registers directly
+ * hardware registers directly; it is empty unless TIM1_PWM_ENABLE=1
+ * (tim1_driver.h)
  * 
  * @date 2026-02-04 
  */
@@ -43,12 +45,13 @@ void Buzzer_Init(uint8_t channel, uint16_t period, uint16_t prescaler);
  * periodic ON/OFF sound generation.
  *
  * @param freq     PWM frequency in Hz.
- * @param duty     PWM duty cycle value.
+ * @param duty     PWM duty cycle when ON, 0 ... 1000 per mille of the
+ *                 period (500 = 50 %), whatever ARR the frequency needs.
  * @param on_ms    Buzzer ON time in milliseconds.
  * @param off_ms   Buzzer OFF time in milliseconds.
  *
- * @note The function Buzzer_Update() must be called periodically
- *       with a fixed time base (e.g. every 1 ms).
+ * @note Buzzer_Update() must be called regularly (e.g. from the main
+ *       loop); the system tick must be running.
  */
 void Buzzer_Start(uint16_t freq, uint16_t duty, uint16_t on_ms, uint16_t off_ms);
 
@@ -58,8 +61,8 @@ void Buzzer_Start(uint16_t freq, uint16_t duty, uint16_t on_ms, uint16_t off_ms)
  * Controls the ON/OFF timing of the buzzer based on
  * the configured durations.
  *
- * This function is non-blocking and must be called
- * periodically with a constant time interval.
+ * This function is non-blocking. Phase lengths are measured with
+ * millis(), so the call interval does not need to be constant.
  */
 void Buzzer_Update(void);
 
@@ -0,0 +1,135 @@
+/**
+ * @file scheduler.h
+ * @brief Cooperative multi-rate task scheduler.
+ *
+ * Tasks are plain functions that run to completion. Each task has a
+ * period; it is released every period_ms milliseconds of millis() time
+ * and must finish before its next release (its deadline).
+ *
+ * The task table (function and period) is `const` and kept in flash;
+ * the caller also provides one sched_state_t per task in RAM for the
+ * release time and statistics.
+ *
+ * `sched_run()` runs every released task once, in table order (earlier
+ * entries first), and returns; the main loop sleeps in between:
+ * @code
+ * static const sched_task_t tasks[] = { {ui_task, 50}, {lcd_task, 500} };
+ * static sched_state_t state[2];
+ *
+ * sched_init(tasks, state, 2);
+ * while (1) { sched_run(); wfi(); }
+ * @endcode
+ *
+ * A task that finishes after its deadline counts as an overrun. When
+ * whole periods were missed the task is not run repeatedly to catch
+ * up: the next release is one period after it finished.
+ *
+ * Overruns are always counted per task (sched_overruns()); the run
+ * counters and sched_get_stats() / sched_reset_stats() are only built
+ * with SCHED_STATS = 1.
+ *
+ * @note Requires the system tick (systick.h).
+ *
+ * @date 2026-02-04
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+/* 1 = also count runs per task (overruns are always counted) */
+#ifndef SCHED_STATS
+#define SCHED_STATS 0
+#endif
+
+/**
+ * @brief Task descriptor (stored in flash).
+ */
+typedef struct {
+    void (*run)(void);    /**< Task function */
+    uint16_t period_ms;   /**< Period, ms (> 0) */
+} sched_task_t;
+
+/**
+ * @brief Task statistics.
+ */
+typedef struct {
+    uint16_t runs;       /**< Completed runs (wraps around) */
+    uint16_t overruns;   /**< Runs that finished after their deadline */
+} sched_stats_t;
+
+/**
+ * @brief Per-task scheduler state (RAM, one per task).
+ */
+typedef struct {
+    uint32_t next_ms;      /**< Next release, millis() time */
+    uint16_t overruns;     /**< Runs that finished after their deadline */
+#if SCHED_STATS
+    uint16_t runs;         /**< Completed runs */
+#endif
+} sched_state_t;
+
+/**
+ * @brief Sets up the scheduler.
+ *
+ * All tasks are released at once.
+ *
+ * @param[in]  tasks  Task table, @p count entries.
+ * @param[out] state  State array, @p count entries.
+ * @param[in]  count  Number of tasks.
+ */
+void sched_init(const sched_task_t *tasks, sched_state_t *state, uint8_t count);
+
+/**
+ * @brief Runs every released task once.
+ *
+ * @retval uint8_t  Number of tasks run.
+ */
+uint8_t sched_run(void);
+
+/**
+ * @brief Returns the earliest release time of all tasks.
+ *
+ * @retval uint32_t  millis() time at which sched_run() has work again.
+ */
+uint32_t sched_next_release(void);
+
+/**
+ * @brief Moves the next release of a task to @p ms from now.
+ *
+ * For tasks that wait for something, e.g. a sensor conversion: the
+ * task asks to run again soon instead of at its full period. The
+ * period counts again from that release.
+ *
+ * @param[in] id  Task index in the table.
+ * @param[in] ms  Delay from now, ms.
+ */
+void sched_wake_in(uint8_t id, uint16_t ms);
+
+/**
+ * @brief Returns the overrun count of a task.
+ *
+ * @param[in] id  Task index in the table.
+ *
+ * @retval uint16_t  Runs that finished after their deadline since
+ *                   sched_init() (wraps around), 0 for an invalid id.
+ */
+uint16_t sched_overruns(uint8_t id);
+
+#if SCHED_STATS
+/**
+ * @brief Copies the statistics of a task.
+ *
+ * @param[in]  id   Task index in the table.
+ * @param[out] out  Destination.
+ */
+void sched_get_stats(uint8_t id, sched_stats_t *out);
+
+/**
+ * @brief Clears the statistics of all tasks.
+ */
+void sched_reset_stats(void);
+#endif
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * @file screen.h
+ * @brief Table-driven LCD screens.
+ *
+ * A screen is a list of pages; a page is a constant table of fields.
+ * Each field describes its position, label, width and number format and
+ * is bound to a data-source function. The tables are `const`, so they
+ * are kept in flash: adding a page or a field costs flash only.
+ *
+ * RAM holds just the last drawn value of each field of the current
+ * page, rounded to the field's step. `screen_update()` reads every
+ * source, rounds it and redraws a field only when the rounded value
+ * (the shown digits) changed; `lcd_flush()` then sends only the
+ * characters that actually changed.
+ *
+ * Example:
+ * @code
+ * static int16_t temp(void) { return sample.temp_c100; }
+ *
+ * static const screen_field_t main_fields[] = {
+ *     // row col label  width dec step source
+ *     {  0,  0, "T ",     5,   1,  10, temp },   // "T  23.4"
+ *     {  0, 10, "C",      0,   0,   0, 0    },   // static text
+ * };
+ * static const screen_page_t pages[] = {
+ *     { main_fields, sizeof(main_fields) / sizeof(main_fields[0]) },
+ * };
+ *
+ * screen_show(&pages[0]);
+ * while (1) { screen_update(); lcd_flush(); }
+ * @endcode
+ *
+ * @date 2026-02-04
+ */
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stdint.h>
+
+/* Most fields on one page (size of the per-field RAM) */
+#ifndef SCREEN_MAX_FIELDS
+#define SCREEN_MAX_FIELDS 8
+#endif
+
+/* Source value for "no data": the field shows dashes */
+#define SCREEN_NO_VALUE ((int16_t)-32768)
+
+/**
+ * @brief Data source of a field.
+ *
+ * @retval int16_t  Current value in the source's own fixed-point unit,
+ *                  or SCREEN_NO_VALUE.
+ */
+typedef int16_t (*screen_source_t)(void);
+
+/**
+ * @brief One field of a page (stored in flash).
+ *
+ * The label is drawn at (row, col) when the page is shown; the value
+ * follows it, right-aligned in `width` columns. A field without a
+ * source is static text.
+ */
+typedef struct {
+    uint8_t  row;             /**< LCD row */
+    uint8_t  col;             /**< LCD column of the label */
+    const char *label;        /**< Text before the value, or 0 */
+    uint8_t  width;           /**< Value width in columns */
+    uint8_t  decimals;        /**< Digits shown after the decimal point */
+    uint16_t step;            /**< Source units per last shown digit (>= 1),
+                                   e.g. 10 to show 0.01 °C data with 1 decimal */
+    screen_source_t source;   /**< Bound value, or 0 for static text */
+} screen_field_t;
+
+/**
+ * @brief One page: a table of fields (stored in flash).
+ */
+typedef struct {
+    const screen_field_t *fields;   /**< Field table */
+    uint8_t count;                  /**< Number of fields (<= SCREEN_MAX_FIELDS) */
+} screen_page_t;
+
+/**
+ * @brief Switches to a page.
+ *
+ * Clears the shadow framebuffer, draws all labels and the current
+ * value of every field. Nothing is sent until `lcd_flush()`.
+ *
+ * @param[in] page  Page to show.
+ */
+void screen_show(const screen_page_t *page);
+
+/**
+ * @brief Redraws the fields of the current page whose value changed.
+ *
+ * A field is redrawn when its source value, rounded to `step`, differs
+ * from the last drawn one, or changes to/from SCREEN_NO_VALUE.
+ *
+ * @retval uint8_t  Number of fields redrawn.
+ */
+uint8_t screen_update(void);
+
+/**
+ * @brief Returns the page currently shown.
+ *
+ * @retval const screen_page_t*  Current page, or 0 before screen_show().
+ */
+const screen_page_t *screen_page(void);
+
+#endif
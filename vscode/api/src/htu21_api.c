@@ -1,143 +1,590 @@
 #include "i2c_driver.h"
 #include "htu21_api.h"
+#include "delay.h"
+#include "systick.h"
+#include "prof.h"
 #include "stm8_s.h"
 
 
+/* No measurement in progress (value of `pending`) */
+#define HTU21_MEAS_NONE 0xFF
+
+/* Interval between NACK polls in the blocking read functions */
+#define HTU21_POLL_MS 2
+
+/*
+ * Datasheet formulas scaled by 100 and by 2^16 (exact, no rounding):
+ *   T  [0.01 °C]  = -4685 + 17572 * raw / 2^16
+ *   RH [0.01 %RH] =  -600 + 12500 * raw / 2^16
+ */
+#define HTU21_T_SCALE   17572UL
+#define HTU21_T_OFFSET  (-4685)
+#define HTU21_RH_SCALE  12500UL
+#define HTU21_RH_OFFSET (-600)
+
+/* CRC-8 generator x^8 + x^5 + x^4 + 1, initial value 0 (datasheet) */
+#define HTU21_CRC_POLY 0x31
+
+/* RH temperature coefficient, -0.15 %RH/°C away from 25 °C, in Q16 */
+#define HTU21_RH_TCOEF_Q16 9830u
+#define HTU21_RH_TREF      2500
+
+/* Sample pipeline states (value of `sample_state`) */
+#define HTU21_SAMPLE_IDLE 0
+#define HTU21_SAMPLE_TEMP 1
+#define HTU21_SAMPLE_HUM  2
+
+
+/**
+ * @brief Maximum conversion times in ms, indexed by htu21_res_index().
+ *
+ * Rows follow the user register encoding: RH12/T14, RH8/T12,
+ * RH10/T13, RH11/T11.
+ */
+static const uint8_t htu21_conv_ms[4][2] = {
+    /* T   RH */
+    { 50, 16 },
+    { 13,  3 },
+    { 25,  5 },
+    {  7,  8 }
+};
+
+/* Row of htu21_conv_ms[] for the resolution bits of a user register value */
+#define htu21_res_index(reg) ((uint8_t)((((reg) >> 6) & 0x02) | ((reg) & 0x01)))
+
+
+#if HTU21_CRC_TABLE
 /**
- * @brief Cached last valid temperature value.
+ * @brief CRC-8 of each high nibble value, i.e. T[n] = crc(n << 4) over 4 bits.
+ *
+ * Processes one nibble per lookup; 16 bytes of flash instead of 256.
+ */
+static const uint8_t htu21_crc_nibble[16] = {
+    0x00, 0x31, 0x62, 0x53, 0xC4, 0xF5, 0xA6, 0x97,
+    0xB9, 0x88, 0xDB, 0xEA, 0x7D, 0x4C, 0x1F, 0x2E
+};
+#endif
+
+
+/**
+ * @brief Cached last valid temperature value, in 0.01 °C.
  *
  * Contains the most recent temperature measurement that was
  * successfully read from the sensor.
  *
  * Initialized to an invalid sentinel value.
  */
-static float last_temp = -1000.0f;
+static int16_t last_temp = HTU21_INVALID;
 
 /**
- * @brief Cached last valid humidity value.
+ * @brief Cached last valid humidity value, in 0.01 %RH.
  *
  * Contains the most recent humidity measurement that was
  * successfully read from the sensor.
  *
  * Initialized to an invalid sentinel value.
  */
-static float last_hum  = -1000.0f;
+static int16_t last_hum  = HTU21_INVALID;
 
+/**
+ * @brief Measurement currently converting in the sensor.
+ *
+ * One of ::htu21_meas_t, or HTU21_MEAS_NONE when idle.
+ */
+static uint8_t pending = HTU21_MEAS_NONE;
+
+/**
+ * @brief Resolution bits currently set in the sensor (::htu21_res_t).
+ */
+static uint8_t resolution = HTU21_RES_RH12_T14;
 
 /**
- * @brief Reads multiple bytes from the HTU21 sensor via I2C.
+ * @brief Step of the sample pipeline (HTU21_SAMPLE_*).
+ */
+static uint8_t sample_state = HTU21_SAMPLE_IDLE;
+
+/**
+ * @brief Number of the next sample record.
+ */
+static uint16_t sample_seq;
+
+/**
+ * @brief millis() at which the conversion of the pipeline is due.
+ */
+static uint32_t sample_due_ms;
+
+/**
+ * @brief millis() of the last trigger command, for the conversion timeout.
+ */
+static uint32_t trigger_ms;
+
+/**
+ * @brief Re-triggers left for the pending measurement.
+ */
+static uint8_t retries_left;
+
+#if HTU21_STATS
+/**
+ * @brief Error counters, see htu21_get_errors().
+ */
+static htu21_errors_t htu21_errors;
+#define HTU21_ERR_INC(field) (htu21_errors.field++)
+#else
+#define HTU21_ERR_INC(field)
+#endif
+
+
+/**
+ * @brief Computes the CRC-8 the sensor appends to each measurement.
  *
- * This function performs a complete I2C transaction to read `len` bytes
- * from the HTU21 sensor. It first sends a command byte, waits for
- * the sensor to perform the measurement, and then reads the data bytes.
+ * @param[in] data  Bytes to check.
+ * @param[in] len   Number of bytes.
  *
- * @param[in]  cmd  Command byte to send to HTU21 (e.g., trigger temperature or humidity measurement).
- * @param[out] buf  Pointer to the buffer where the received data will be stored.
- * @param[in]  len  Number of bytes to read.
+ * @retval uint8_t  CRC-8 (poly 0x31, init 0x00, no final XOR).
+ */
+static uint8_t htu21_crc8(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0;
+#if !HTU21_CRC_TABLE
+    uint8_t bit;
+#endif
+
+    while (len--) {
+        crc ^= *data++;
+#if HTU21_CRC_TABLE
+        crc = (uint8_t)(crc << 4) ^ htu21_crc_nibble[crc >> 4];
+        crc = (uint8_t)(crc << 4) ^ htu21_crc_nibble[crc >> 4];
+#else
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ HTU21_CRC_POLY)
+                               : (uint8_t)(crc << 1);
+#endif
+    }
+
+    return crc;
+}
+
+
+/**
+ * @brief Sends the trigger command for a measurement.
  *
- * @retval 0   Data successfully read.
- * @retval -1  I2C communication error occurred (start, address, write, or read failure).
+ * @param[in] meas  Measurement to start.
  *
- * @note This function waits ~50 ms after sending the command to allow the HTU21
- *       to perform the conversion.
- * @note The last byte is read with NACK to indicate the end of reading.
+ * @retval 0   Conversion started, `pending` set.
+ * @retval -1  I2C communication error.
  */
-static int htu21_read_bytes(unsigned char cmd, unsigned char *buf, unsigned char len)
+static int htu21_start(uint8_t meas)
 {
+    uint8_t cmd = (meas == HTU21_MEAS_TEMP) ? HTU21_TRIGTEMP : HTU21_TRIGHUM;
+
+    pending = HTU21_MEAS_NONE;
+
+    if (i2c_master_transmit(HTU21_I2C_ADDR, &cmd, 1) != 0) {
+        HTU21_ERR_INC(i2c);
+        return -1;
+    }
+
+    pending    = meas;
+    trigger_ms = millis();
+    return 0;
+}
+
+
+/**
+ * @brief Handles a failed read of the pending measurement.
+ *
+ * Re-triggers the same conversion while retries are left, so a single
+ * corrupted frame costs one extra conversion instead of a bad value.
+ *
+ * @retval HTU21_BUSY  Conversion restarted, keep polling.
+ * @retval -1          Retries exhausted or re-trigger failed.
+ */
+static int htu21_retry(void)
+{
+    if (retries_left) {
+        retries_left--;
+        HTU21_ERR_INC(retries);
+
+        if (htu21_start(pending) == 0)
+            return HTU21_BUSY;
+    }
+
+    pending = HTU21_MEAS_NONE;
+    return -1;
+}
+
+
+//Converts a raw temperature reading to 0.01 °C
+int16_t htu21_temp_c100(uint16_t raw)
+{
+    raw &= 0xFFFC; // status bits
+
+    return (int16_t)((int16_t)(((uint32_t)raw * HTU21_T_SCALE + 0x8000UL) >> 16) + HTU21_T_OFFSET);
+}
+
+
+//Converts a raw humidity reading to 0.01 %RH
+int16_t htu21_hum_c100(uint16_t raw)
+{
+    raw &= 0xFFFC; // status bits
+
+    return (int16_t)((int16_t)(((uint32_t)raw * HTU21_RH_SCALE + 0x8000UL) >> 16) + HTU21_RH_OFFSET);
+}
+
+
+//Starts a temperature or humidity conversion without waiting for it
+int htu21_trigger(htu21_meas_t meas)
+{
+    retries_left = HTU21_RETRIES;
+
+    return htu21_start((uint8_t)meas);
+}
+
+
+
+//Collects the result of the conversion started by htu21_trigger()
+int htu21_poll(void)
+{
+    uint8_t buf[3];
+    uint16_t raw;
     int rc;
-    unsigned char i;
-    int d;
 
-    rc = i2c_master_start();
-    if (rc != 0) return -1;
+    if (pending == HTU21_MEAS_NONE)
+        return -1;
+
+    // the sensor NACKs its read address until the conversion is done
+    rc = i2c_master_receive(HTU21_I2C_ADDR, buf, 3);
+    if (rc == I2C_ERR_NACK)
+        return HTU21_BUSY;
 
-    rc = i2c_master_send_addr(HTU21_I2C_ADDR, 0); // write 
     if (rc != 0) {
-        i2c_master_stop();
+        HTU21_ERR_INC(i2c);
+        return htu21_retry();
+    }
+
+    if (htu21_crc8(buf, 2) != buf[2]) {
+        HTU21_ERR_INC(crc);
+        return htu21_retry();
+    }
+
+    raw = (uint16_t)(((uint16_t)buf[0] << 8) | buf[1]);
+
+    if (pending == HTU21_MEAS_TEMP) {
+        last_temp = htu21_temp_c100(raw);
+    } else {
+        last_hum  = htu21_hum_c100(raw);
+    }
+
+    pending = HTU21_MEAS_NONE;
+    return 0;
+}
+
+#if HTU21_BLOCKING_API
+/**
+ * @brief Runs one measurement to completion.
+ *
+ * Triggers the conversion, waits for the conversion time at the current
+ * resolution and then NACK-polls the sensor every HTU21_POLL_MS
+ * milliseconds until the result is available. Each retry started by
+ * htu21_poll() gets its own conversion time.
+ *
+ * @param[in] meas  Measurement to run.
+ *
+ * @retval 0   Result stored in `last_temp` / `last_hum`.
+ * @retval -1  I2C or CRC error after all retries, or the sensor did
+ *             not answer within twice the conversion time.
+ */
+static int htu21_measure(htu21_meas_t meas)
+{
+    uint8_t conv_ms = htu21_conv_time_ms(meas);
+    uint8_t tries = (uint8_t)((conv_ms / HTU21_POLL_MS + 1u) * (HTU21_RETRIES + 1u));
+    int rc;
+
+    if (htu21_trigger(meas) != 0)
         return -1;
+
+    delay_ms(conv_ms);
+
+    while ((rc = htu21_poll()) == HTU21_BUSY && --tries)
+        delay_ms(HTU21_POLL_MS);
+
+    if (rc == HTU21_BUSY) {
+        HTU21_ERR_INC(timeout);
+        pending = HTU21_MEAS_NONE;
     }
+    return (rc == 0) ? 0 : -1;
+}
 
-    rc = i2c_master_write_byte(cmd);
-    if (rc != 0) {
-        i2c_master_stop();
+
+
+//Reads the temperature from the HTU21 sensor, in 0.01 °C
+int16_t htu21_read_temperature_c100(void)
+{
+    if (htu21_measure(HTU21_MEAS_TEMP) != 0)
+        return HTU21_INVALID;
+
+    return last_temp;
+}
+
+
+
+//Reads the relative humidity from the HTU21 sensor, in 0.01 %RH
+int16_t htu21_read_humidity_c100(void)
+{
+    if (htu21_measure(HTU21_MEAS_HUM) != 0)
+        return HTU21_INVALID;
+
+    return last_hum;
+}
+#endif
+
+
+//Returns the last successfully read temperature, in 0.01 °C
+int16_t htu21_last_temperature_c100(void) { return last_temp; }
+
+
+//Returns the last successfully read relative humidity, in 0.01 %RH
+int16_t htu21_last_humidity_c100(void)    { return last_hum;  }
+
+
+//Applies the RH temperature coefficient of the sensor
+int16_t htu21_hum_comp_c100(int16_t t_c100, int16_t rh_c100)
+{
+    int16_t dt = (int16_t)(t_c100 - HTU21_RH_TREF);
+    int16_t corr;
+
+    if (t_c100 == HTU21_INVALID || rh_c100 == HTU21_INVALID)
+        return HTU21_INVALID;
+
+    // shift a magnitude: right shifts of negative values are not portable
+    if (dt < 0)
+        corr = -(int16_t)(((uint32_t)(-dt) * HTU21_RH_TCOEF_Q16 + 0x8000UL) >> 16);
+    else
+        corr =  (int16_t)(((uint32_t)dt * HTU21_RH_TCOEF_Q16 + 0x8000UL) >> 16);
+
+    rh_c100 = (int16_t)(rh_c100 + corr);
+
+    if (rh_c100 < 0)     rh_c100 = 0;
+    if (rh_c100 > 10000) rh_c100 = 10000;
+    return rh_c100;
+}
+
+
+/**
+ * @brief Starts the next conversion of the sample pipeline.
+ *
+ * @param[in] state  HTU21_SAMPLE_TEMP or HTU21_SAMPLE_HUM.
+ *
+ * @retval HTU21_BUSY  Conversion started.
+ * @retval -1          I2C communication error, pipeline reset.
+ */
+static int htu21_sample_start(uint8_t state)
+{
+    if (htu21_trigger(state == HTU21_SAMPLE_TEMP ? HTU21_MEAS_TEMP : HTU21_MEAS_HUM) != 0) {
+        sample_state = HTU21_SAMPLE_IDLE;
         return -1;
     }
 
-    i2c_master_stop();
+    sample_state  = state;
+    sample_due_ms = millis() + htu21_conv_time_ms(state == HTU21_SAMPLE_TEMP ? HTU21_MEAS_TEMP : HTU21_MEAS_HUM);
+    return HTU21_BUSY;
+}
+
 
-    delay_ms(50);
+//Advances the temperature/humidity sample pipeline without blocking
+int htu21_sample_step(htu21_sample_t *out)
+{
+    int rc;
 
-    rc = i2c_master_start();
-    if (rc != 0) return -1;
+    if (sample_state == HTU21_SAMPLE_IDLE)
+        return htu21_sample_start(HTU21_SAMPLE_TEMP);
+
+    // no bus traffic before the conversion time has passed
+    if (systick_running() && !TIME_REACHED(millis(), sample_due_ms))
+        return HTU21_BUSY;
+
+    PROF_BEGIN(PROF_HTU21_READ);
+    rc = htu21_poll();
+    PROF_END(PROF_HTU21_READ);
+    if (rc == HTU21_BUSY) {
+        // still NACKing after twice the conversion time: give up until
+        // the next sample instead of polling an absent sensor
+        if (!systick_running() ||
+            TIME_SINCE(millis(), trigger_ms) < 2u * htu21_conv_time_ms((htu21_meas_t)pending))
+            return HTU21_BUSY;
+
+        HTU21_ERR_INC(timeout);
+        sample_state = HTU21_SAMPLE_IDLE;
+        pending = HTU21_MEAS_NONE;
+        return -1;
+    }
 
-    rc = i2c_master_send_addr(HTU21_I2C_ADDR, 1); // read 
     if (rc != 0) {
-        i2c_master_stop();
+        sample_state = HTU21_SAMPLE_IDLE;
         return -1;
     }
 
-    for (i = 0; i < len; i++) {
-        d = i2c_master_read_byte((i < (len - 1)) ? 1 : 0);
-        if (d < 0) {
-            i2c_master_stop();
-            return -1;
+    // temperature is in: start humidity right away
+    if (sample_state == HTU21_SAMPLE_TEMP)
+        return htu21_sample_start(HTU21_SAMPLE_HUM);
+
+    sample_state = HTU21_SAMPLE_IDLE;
+
+    out->seq            = sample_seq++;
+    out->t_ms           = millis();
+    out->temp_c100      = last_temp;
+    out->hum_c100       = last_hum;
+    out->hum_comp_c100  = htu21_hum_comp_c100(last_temp, last_hum);
+    return 0;
+}
+
+#if HTU21_BLOCKING_API
+//Takes one complete temperature/humidity sample
+int htu21_sample(htu21_sample_t *out)
+{
+    uint8_t tries = (uint8_t)(((htu21_conv_time_ms(HTU21_MEAS_TEMP) +
+                                htu21_conv_time_ms(HTU21_MEAS_HUM)) / HTU21_POLL_MS + 2u) *
+                              (HTU21_RETRIES + 1u));
+    uint8_t seen = HTU21_SAMPLE_IDLE;
+    int rc;
+
+    rc = htu21_sample_step(out);
+
+    while (rc == HTU21_BUSY && --tries) {
+        // full conversion time after each trigger, short polls after that
+        if (sample_state != seen) {
+            seen = sample_state;
+            delay_ms(htu21_conv_time_ms(seen == HTU21_SAMPLE_TEMP ? HTU21_MEAS_TEMP : HTU21_MEAS_HUM));
+        } else {
+            delay_ms(HTU21_POLL_MS);
         }
-        buf[i] = (unsigned char)d;
+        rc = htu21_sample_step(out);
+    }
+
+    if (rc == HTU21_BUSY) {
+        HTU21_ERR_INC(timeout);
+        sample_state = HTU21_SAMPLE_IDLE;
+        pending = HTU21_MEAS_NONE;
+    }
+    return (rc == 0) ? 0 : -1;
+}
+#endif
+
+
+#if HTU21_USER_REG_API
+//Reads the sensor's user register
+int htu21_read_user_reg(uint8_t *reg)
+{
+    uint8_t cmd = HTU21_READREG;
+
+    if (i2c_master_transfer(HTU21_I2C_ADDR, &cmd, 1, reg, 1) != 0) {
+        HTU21_ERR_INC(i2c);
+        return -1;
     }
 
     return 0;
 }
 
 
+//Writes the sensor's user register
+int htu21_write_user_reg(uint8_t reg)
+{
+    uint8_t buf[2];
 
-//Reads the temperature from the HTU21 sensor.
-float htu21_read_temperature(void)
+    buf[0] = HTU21_WRITEREG;
+    buf[1] = reg;
+
+    if (i2c_master_transmit(HTU21_I2C_ADDR, buf, 2) != 0) {
+        HTU21_ERR_INC(i2c);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+//Selects the measurement resolution, keeping the other register bits
+int htu21_set_resolution(htu21_res_t res)
+{
+    uint8_t reg;
+
+    if (htu21_read_user_reg(&reg) != 0)
+        return -1;
+
+    reg = (uint8_t)((reg & (uint8_t)~HTU21_REG_RES) | ((uint8_t)res & HTU21_REG_RES));
+
+    if (htu21_write_user_reg(reg) != 0)
+        return -1;
+
+    resolution = (uint8_t)res & HTU21_REG_RES;
+    return 0;
+}
+
+
+//Returns the current measurement resolution
+htu21_res_t htu21_get_resolution(void)
 {
-    unsigned char buf[3];
-    unsigned int t;
-    float temp;
+    return (htu21_res_t)resolution;
+}
+#endif
 
-    if (htu21_read_bytes(HTU21_READTEMP, buf, 3) != 0)
-        return -1000.0f;
 
-    t = ((unsigned int)buf[0] << 8) | (buf[1] & 0xFC);
+//Returns the maximum conversion time at the current resolution
+uint8_t htu21_conv_time_ms(htu21_meas_t meas)
+{
+    return htu21_conv_ms[htu21_res_index(resolution)][meas == HTU21_MEAS_HUM];
+}
 
-    temp = (float)t;
-    temp *= 175.72f;
-    temp /= 65536.0f;
-    temp -= 46.85f;
 
-    last_temp = temp;
-    return temp;
+#if HTU21_STATS
+//Copies the error counters
+void htu21_get_errors(htu21_errors_t *out)
+{
+    *out = htu21_errors;
 }
 
 
+//Clears the error counters
+void htu21_reset_errors(void)
+{
+    htu21_errors.crc     = 0;
+    htu21_errors.i2c     = 0;
+    htu21_errors.timeout = 0;
+    htu21_errors.retries = 0;
+}
+#endif
 
-//Reads the relative humidity from the HTU21 sensor.
-float htu21_read_humidity(void)
+
+#if HTU21_FLOAT_API
+//Reads the temperature from the HTU21 sensor.
+float htu21_read_temperature(void)
 {
-    unsigned char buf[3];
-    unsigned int h;
-    float hum;
+    int16_t t = htu21_read_temperature_c100();
 
-    if (htu21_read_bytes(HTU21_READHUM, buf, 3) != 0)
-        return -1000.0f;
+    return (t == HTU21_INVALID) ? -1000.0f : (float)t / 100.0f;
+}
 
-    h = ((unsigned int)buf[0] << 8) | (buf[1] & 0xFC);
 
-    hum = (float)h;
-    hum *= 125.0f;
-    hum /= 65536.0f;
-    hum -= 6.0f;
 
-    last_hum = hum;
-    return hum;
+//Reads the relative humidity from the HTU21 sensor.
+float htu21_read_humidity(void)
+{
+    int16_t h = htu21_read_humidity_c100();
+
+    return (h == HTU21_INVALID) ? -1000.0f : (float)h / 100.0f;
 }
 
 
 //Returns the last successfully read temperature from HTU21.
-float htu21_last_temperature(void) { return last_temp; }
+float htu21_last_temperature(void)
+{
+    return (last_temp == HTU21_INVALID) ? -1000.0f : (float)last_temp / 100.0f;
+}
 
 
 //Returns the last successfully read relative humidity from HTU21.
-float htu21_last_humidity(void)    { return last_hum;  }
+float htu21_last_humidity(void)
+{
+    return (last_hum == HTU21_INVALID) ? -1000.0f : (float)last_hum / 100.0f;
+}
+#endif
@@ -1,158 +1,375 @@
 #include "lcd_api.h"
 #include "i2c_driver.h"
 #include "delay.h"
+#include "numfmt.h"
+#include "prof.h"
 #include "stm8_s.h"
 
 
 
+/* HD44780 instructions that need the long (1.52 ms) execution time */
+#define LCD_CMD_CLEAR 0x01
+#define LCD_CMD_HOME  0x02
+
+#if LCD_BUSY_FLAG
+/* Busy flag: bit 7 of the status read (D7) */
+#define LCD_BF PIN_D7
+
+/* Expander output for a status read: data lines released (high), RW = 1 */
+#define LCD_RD (PIN_D4 | PIN_D5 | PIN_D6 | PIN_D7 | PIN_RW)
+
+/* Busy-flag reads before giving up on a command (~0.9 ms each at 100 kHz) */
+#ifndef LCD_BF_POLLS
+#define LCD_BF_POLLS 8
+#endif
+#endif
+
+/* Fixed wait after clear/home when the busy flag cannot be read */
+#define LCD_SLOW_CMD_MS 2
+
+/* Characters packed into one I2C transaction by lcd_write() */
+#define LCD_STREAM_CHARS LCD_COLS
+
+/* Expander bytes for a streamed chunk: 4 per character */
+static uint8_t lcd_stream[LCD_STREAM_CHARS * 4];
+
+/* DDRAM address of the first column of each row */
+static const uint8_t lcd_row_addr[LCD_ROWS] = {0x00, 0x40};
+
+/* Frame being drawn: what the display should show after lcd_flush() */
+static char lcd_fb[LCD_ROWS][LCD_COLS];
+
+/* Shadow of the DDRAM: what the display shows now */
+static char lcd_shown[LCD_ROWS][LCD_COLS];
+
+/* Set by lcd_invalidate(): next flush resends every cell */
+static uint8_t lcd_force = 0;
+
+/* Backlight bit sent with every expander byte: PIN_BL or 0 */
+static uint8_t lcd_bl = PIN_BL;
+
+/* 1 while busy-flag reads work; cleared on the first failed or timed-out read */
+static uint8_t lcd_bf_ok = 0;
+
+/* Shadow cursor used by the drawing functions */
+static uint8_t lcd_row = 0;
+static uint8_t lcd_col = 0;
+
+
+/**
+ * @brief Packs one LCD byte into the four PCF8574 output bytes.
+ *
+ * The byte is split into upper and lower nibbles (4-bit mode); each
+ * nibble is written once with EN high and once with EN low so the LCD
+ * latches it on the falling edge. The backlight bit is kept as set by
+ * lcd_backlight().
+ *
+ * @param[out] dst  Destination for 4 expander bytes.
+ * @param[in]  val  Command or data byte.
+ * @param[in]  rs   PIN_RS for data, 0 for commands.
+ */
+static void lcd_pack(uint8_t *dst, uint8_t val, uint8_t rs)
+{
+    uint8_t hi = (uint8_t)(val & 0xF0);
+    uint8_t lo = (uint8_t)(val << 4);
+
+    dst[0] = (uint8_t)(hi | rs | PIN_EN | lcd_bl);
+    dst[1] = (uint8_t)(hi | rs | lcd_bl);
+    dst[2] = (uint8_t)(lo | rs | PIN_EN | lcd_bl);
+    dst[3] = (uint8_t)(lo | rs | lcd_bl);
+}
+
+
+/**
+ * @brief Writes one nibble with a single EN pulse (8-bit mode init only).
+ *
+ * @param[in] val  Nibble in bits 7..4.
+ */
+static void lcd_send_nibble(uint8_t val)
+{
+    uint8_t data_t[2];
+
+    data_t[0] = (uint8_t)((val & 0xF0) | PIN_EN | lcd_bl);
+    data_t[1] = (uint8_t)((val & 0xF0) | lcd_bl);
+    i2c_master_transmit(LCD_ADDR, data_t, 2);
+}
+
+#if LCD_BUSY_FLAG
+/**
+ * @brief Waits until the LCD controller clears its busy flag.
+ *
+ * Reads the instruction register in 4-bit mode: the data lines are
+ * released (the PCF8574 pins are quasi-bidirectional, writing 1 lets
+ * the LCD drive them), RW is raised and EN pulsed twice. The expander
+ * samples its pins at the ACK of the read address, while EN of the
+ * first (high) nibble is still high, so D7 carries the busy flag.
+ * The second pulse only completes the read. The last byte drops RW
+ * with EN low, so the next write does not change RW and EN together.
+ *
+ * @retval  0  Controller ready.
+ * @retval -1  I2C error or still busy after LCD_BF_POLLS reads
+ *             (e.g. RW tied to GND on the adapter).
+ */
+static int8_t lcd_wait_ready(void)
+{
+    uint8_t rd_hi[2];
+    uint8_t rd_lo[4];
+    uint8_t status;
+    uint8_t polls;
+
+    rd_hi[0] = rd_lo[0] = rd_lo[2] = (uint8_t)(LCD_RD | lcd_bl);
+    rd_hi[1] = rd_lo[1] = (uint8_t)(LCD_RD | PIN_EN | lcd_bl);
+    rd_lo[3] = lcd_bl;
+
+    for (polls = 0; polls < LCD_BF_POLLS; polls++)
+    {
+        if (i2c_master_transfer(LCD_ADDR, rd_hi, 2, &status, 1) != I2C_OK) return -1;
+        if (i2c_master_transmit(LCD_ADDR, rd_lo, 4) != I2C_OK) return -1;
+
+        if (!(status & LCD_BF)) return 0;
+    }
+
+    return -1;
+}
+#endif
+
+/**
+ * @brief Waits for the end of a long instruction (clear, home).
+ *
+ * Uses the busy flag while it works (LCD_BUSY_FLAG=1) and falls back
+ * to a fixed LCD_SLOW_CMD_MS delay for good after the first failure. Other
+ * instructions take 37 us, less than the next I2C frame, so no
+ * wait is needed for them.
+ *
+ * @param[in] cmd  Instruction just sent.
+ */
+static void lcd_cmd_wait(uint8_t cmd)
+{
+    // clear is 0x01, home is 0x02/0x03 (bit 0 ignored)
+    if (cmd < LCD_CMD_CLEAR || cmd > (LCD_CMD_HOME | 1)) return;
+
+#if LCD_BUSY_FLAG
+    if (lcd_bf_ok && lcd_wait_ready() == 0) return;
+
+    lcd_bf_ok = 0;
+#endif
+    delay_ms(LCD_SLOW_CMD_MS);
+}
+
+
 //Sends a command byte to the LCD via PCF8574 I2C I/O expander.
 void lcd_send_cmd(char cmd){
-    char data_u, data_l;
     uint8_t data_t[4];
 
-    data_u = (cmd & 0xF0);
-    data_l = ((cmd << 4) & 0xf0);
-
-    data_t[0] = data_u | 0x0C;   
-    data_t[1] = data_u | 0x08;
-    data_t[2] = data_l | 0x0C;   
-    data_t[3] = data_l | 0x08;
-
-    i2c_master_transmit(0x27, data_t, 4);
+    lcd_pack(data_t, (uint8_t)cmd, 0);
+    i2c_master_transmit(LCD_ADDR, data_t, 4);
+    lcd_cmd_wait((uint8_t)cmd);
 }
 
 
 //Sends a data byte to the LCD via PCF8574 I2C I/O expander
 void lcd_send_data (char data)
 {
-	char data_u, data_l;
-	uint8_t data_t[4];
-	data_u = (data&0xf0);
-	data_l = ((data<<4)&0xf0);
-	data_t[0] = data_u|0x0D;  
-	data_t[1] = data_u|0x09;  
-	data_t[2] = data_l|0x0D;  
-	data_t[3] = data_l|0x09;
-    i2c_master_transmit(0x27, data_t, 4);
+    uint8_t data_t[4];
+
+    lcd_pack(data_t, (uint8_t)data, PIN_RS);
+    i2c_master_transmit(LCD_ADDR, data_t, 4);
+}
+
+
+//Writes a run of characters to the LCD in as few I2C transactions as possible
+void lcd_write(const char *buf, uint8_t len)
+{
+    uint8_t n;
+    uint8_t i;
+
+    while (len)
+    {
+        n = (len > LCD_STREAM_CHARS) ? LCD_STREAM_CHARS : len;
+
+        for (i = 0; i < n; i++)
+        {
+            lcd_pack(&lcd_stream[i * 4u], (uint8_t)buf[i], PIN_RS);
+        }
+        i2c_master_transmit(LCD_ADDR, lcd_stream, (uint16_t)(n * 4u));
+
+        buf += n;
+        len -= n;
+    }
 }
 
 
 //Initializes the LCD via PCF8574 I2C I/O expander
 void lcd_init(void){
+    uint8_t row, col;
 
-    
+    // 8-bit mode reset: single nibbles, busy flag not readable yet
     delay_ms(50);
-    lcd_send_cmd(0x30);
+    lcd_send_nibble(0x30);
     delay_ms(5);
-    lcd_send_cmd(0x30);
-    delay_us(200);
-    lcd_send_cmd(0x30);
-    delay_ms(10);
-    lcd_send_cmd(0x20);
-    delay_ms(10);
-
-     
+    lcd_send_nibble(0x30);
+    DELAY_US(200);
+    lcd_send_nibble(0x30);
+    DELAY_US(200);
+    lcd_send_nibble(0x20);
+
+    // 4-bit mode from here: probe the busy flag once
+#if LCD_BUSY_FLAG
+    lcd_bf_ok = (uint8_t)(lcd_wait_ready() == 0);
+#endif
+    if (!lcd_bf_ok) delay_ms(1);
+
     lcd_send_cmd (0x28);
-    delay_ms(1);
     lcd_send_cmd (0x08);
-    delay_ms(1);
-    lcd_send_cmd (0x01);
-    delay_ms(2);
+    lcd_send_cmd (LCD_CMD_CLEAR);
     lcd_send_cmd (0x06);
-    delay_ms(1);
     lcd_send_cmd (0x0C);
+
+    // display is blank now: shadow matches it
+    lcd_clear();
+    for (row = 0; row < LCD_ROWS; row++)
+        for (col = 0; col < LCD_COLS; col++) lcd_shown[row][col] = ' ';
+    lcd_force = 0;
 }
 
-//ends a null-terminated string to the LCD
+
+/**
+ * @brief Draws one character into the frame at the shadow cursor.
+ *
+ * Characters past the last column are clipped.
+ *
+ * @param[in] c  Character to draw.
+ */
+static void lcd_fb_putc(char c)
+{
+    if (lcd_col >= LCD_COLS) return;
+
+    lcd_fb[lcd_row][lcd_col++] = c;
+}
+
+//Draws a null-terminated string into the shadow framebuffer
 void lcd_send_string (char *str)
 {
-    while (*str) lcd_send_data (*str++);
-    
+    while (*str) lcd_fb_putc(*str++);
+}
+
+//Draws one character into the shadow framebuffer
+void lcd_send_char(char c)
+{
+    lcd_fb_putc(c);
 }
 
 //Sets the cursor position on the LCD
 void lcd_put_cur(int row, int col)
 {
-    switch (row)
+    if (row < 0 || row >= LCD_ROWS) row = 0;
+    if (col < 0) col = 0;
+
+    lcd_row = (uint8_t)row;
+    lcd_col = (uint8_t)col;
+}
+
+//Sends the changed runs of the shadow framebuffer to the LCD
+uint8_t lcd_flush(void)
+{
+    uint8_t row;
+    uint8_t start;
+    uint8_t end;
+    uint8_t sent = 0;
+    char *fb;
+    char *shown;
+
+    for (row = 0; row < LCD_ROWS; row++)
     {
-        case 0:
-            col |= 0x80;
-            break;
-        case 1:
-            col |= 0xC0;
-            break;
+        fb    = lcd_fb[row];
+        shown = lcd_shown[row];
+        start = 0;
+
+        while (start < LCD_COLS)
+        {
+            // skip unchanged cells, then take the run of changed ones
+            if (!lcd_force && fb[start] == shown[start]) { start++; continue; }
+
+            end = start;
+            while (end < LCD_COLS && (lcd_force || fb[end] != shown[end]))
+            {
+                shown[end] = fb[end];
+                end++;
+            }
+
+            lcd_send_cmd((char)(0x80 | (lcd_row_addr[row] + start)));
+            lcd_write(&fb[start], (uint8_t)(end - start));
+            sent += (uint8_t)(end - start);
+            start = end;
+        }
     }
-    lcd_send_cmd (col);
+    lcd_force = 0;
+
+    return (uint8_t)(LCD_ROWS * LCD_COLS - sent);
+}
+
+//Marks the whole shadow framebuffer dirty
+void lcd_invalidate(void)
+{
+    lcd_force = 1;
 }
 
 //Sends an integer number to the LCD as a string
-void lcd_send_int(int num){
-
-    char buf[10];    
-    int i = 0, j;
-    char tmp[10];
-
-    if (num == 0) {
-        buf[0] = '0';
-        buf[1] = '\0';
-    } else {
-        while (num > 0) {
-            tmp[i++] = (num % 10) + '0';
-            num /= 10;
-        }
-        for (j = 0; j < i; j++) {
-            buf[j] = tmp[i - j - 1];
-        }
-        buf[i] = '\0';
-    }
+void lcd_send_int(int num)
+{
+    fmt_fixed(lcd_fb_putc, num, 0, 0, ' ');
+}
 
-    lcd_send_string (buf);
+//Draws a fixed-point number into the shadow framebuffer
+void lcd_send_fixed(int32_t value, uint8_t decimals, uint8_t width)
+{
+    if (width > LCD_COLS) width = LCD_COLS;
 
+    // digits go straight into the framebuffer, clipped at the row end
+    fmt_fixed(lcd_fb_putc, value, decimals, width, ' ');
 }
 
-//Clears the LCD display and resets the cursor to home
+//Clears the shadow framebuffer and resets the cursor to home
 void lcd_clear(void){
-    lcd_send_cmd (0x01);
-    delay_ms(2);
+    uint8_t col;
+
+    for (lcd_row = 0; lcd_row < LCD_ROWS; lcd_row++)
+    {
+        lcd_col = 0;
+        for (col = 0; col < LCD_COLS; col++) lcd_fb_putc(' ');
+    }
+    lcd_row = 0;
+    lcd_col = 0;
 }
 
 
+#if LCD_FLOAT_API
 //Sends a floating-point number to the LCD as a string
 void lcd_send_float(float num)
 {
-    char result[5];   
-    int int_part;
-    int frac_part;
-    int i = 0;
-
-    if (num < 0) {
-        num = -num;
-        lcd_send_string("-"); 
-    }
-
-    num += 0.05f;
-
-
-    int_part = (int)num;
-    frac_part = (int)(num * 10.0f) % 10;
+    PROF_BEGIN(PROF_LCD_FLOAT);
+    // tenths, rounded half away from zero
+    fmt_fixed(lcd_fb_putc, (int32_t)(num * 10.0f + (num < 0 ? -0.5f : 0.5f)), 1, 0, ' ');
+    PROF_END(PROF_LCD_FLOAT);
+}
+#endif
 
-    if (int_part >= 100) {
-        result[i++] = (int_part / 100) + '0';
-        result[i++] = ((int_part / 10) % 10) + '0';
-        result[i++] = (int_part % 10) + '0';
-    } else if (int_part >= 10) {
-        result[i++] = (int_part / 10) + '0';
-        result[i++] = (int_part % 10) + '0';
-    } else {
-        result[i++] = int_part + '0';
-    }
 
-    result[i++] = '.';
+//Reports whether commands wait on the busy flag
+uint8_t lcd_busy_flag_ok(void)
+{
+    return lcd_bf_ok;
+}
 
 
-    result[i++] = frac_part + '0';
+//Switches the LCD backlight on or off
+void lcd_backlight(uint8_t on)
+{
+    uint8_t bl = on ? PIN_BL : 0;
 
-    result[i] = '\0';
+    if (bl == lcd_bl) return;
 
-    lcd_send_string(result);
+    lcd_bl = bl;
+    // EN low, RW low: only the backlight output changes
+    i2c_master_transmit(LCD_ADDR, &lcd_bl, 1);
 }
\ No newline at end of file
@@ -2,92 +2,392 @@
 #include "stm8_s.h"
 #include "exti_driver.h"
 #include "tim2_driver.h"
+#include "clock.h"
+#include "power.h"
+#include "prof.h"
 
-#define INTERRUPT @far @interrupt
-#define INTERRUPT_HANDLER(a,b) @far @interrupt void a(void)
+/* PWM backends; the UART backend is in mh-z19b_uart.c */
+#if MHZ19_BACKEND != MHZ19_BACKEND_UART
 
-INTERRUPT void EXTI_PORTB_IRQHandler(void);
 /* ================= CONFIG ================= */
 #define MHZ19_PWM_PORT   GPIOD
-#define MHZ19_PWM_PIN    3
+#define MHZ19_PWM_PIN    3              /* PD3 = TIM2_CH2 */
 #define MHZ19_EXTI_PORT  EXTI_PORT_GPIOD
 
+/*
+ * TIM2 at fMASTER / 2^clock_timer_psc() = 4 µs per tick in every clock
+ * profile (16 MHz / 64 ... 2 MHz / 8), 16-bit wrap every 262 ms
+ */
+#define MHZ19_TIM2_PRESCALER ((TIM2_Prescaler_TypeDef)clock_timer_psc())
+
+/* Input capture filter: fMASTER/32, N = 8 (16 µs at 16 MHz), same delay on both edges */
+#define MHZ19_IC_FILTER  0x0F
+
+/* Fixed 2 ms start/end segments of every PWM cycle */
+#define MHZ19_T2MS  MHZ19_MS_TO_TICKS(2)
+#define MHZ19_T4MS  MHZ19_MS_TO_TICKS(4)
+
+/* Accepted cycle period: 1004 ms nominal, ±5 % (datasheet) */
+#define MHZ19_PERIOD_NOM  MHZ19_MS_TO_TICKS(1004)
+#define MHZ19_PERIOD_MIN  MHZ19_MS_TO_TICKS(954)
+#define MHZ19_PERIOD_MAX  MHZ19_MS_TO_TICKS(1054)
+
+/*
+ * Division-free ppm (mhz19_cycle_ppm()), constants for 4 µs ticks:
+ *   nominal span T - 4 ms = 250000 ticks, 5000 / 250000 = 1 / 50
+ *   x / 50     = x * 5243 >> 18
+ *   y / 250000 = y * 4295 >> 30
+ * Periods further than MHZ19_FAST_DEV ticks (2 %) from nominal use the
+ * exact divide.
+ */
+#if MHZ19_TICK_US != 4
+#error "mhz19_cycle_ppm() constants assume 4 us ticks"
+#endif
+#define MHZ19_DIV50_MUL   5243UL
+#define MHZ19_DIV50_SHIFT 18
+#define MHZ19_SPAN_MUL    4295UL
+#define MHZ19_FAST_DEV    5000UL
+
 /* ================= STATE ================= */
+/* Edge bookkeeping, ISR only */
 typedef struct {
-    volatile uint16_t lastRise;
-    volatile uint16_t lastFall;
-    volatile uint16_t tHigh;
-    volatile uint16_t tLow;
-    volatile uint8_t  ready;
+    uint32_t lastRise;
+    uint32_t lastFall;
+    uint32_t tLow;
 } MHZ19_PWM_State_t;
 
 static MHZ19_PWM_State_t pwm;
 
+/*
+ * Last validated cycle, written by the ISR and read by the main loop
+ * without masking interrupts: the ISR increments `seq` before and
+ * after writing, a reader retries until it sees the same even value
+ * on both sides of its copy.
+ */
+typedef struct {
+    volatile uint8_t  seq;
+    volatile uint8_t  count;   /* validated cycles, wraps */
+    volatile uint32_t high;
+    volatile uint32_t period;
+} MHZ19_PWM_Cycle_t;
+
+static MHZ19_PWM_Cycle_t cycle;
+
+static uint8_t  ppm_count;     /* cycle.count already consumed */
+
+#if MHZ19_FILTER_LEN
+/* Main-loop filter: last MHZ19_FILTER_LEN readings, median, then EMA */
+static uint16_t ppm_ring[MHZ19_FILTER_LEN];
+static uint8_t  ppm_fill;
+static uint8_t  ppm_idx;
+static uint16_t ppm_ema_x8;    /* EMA output * 8 (fits 5000 ppm) */
+#else
+static uint16_t ppm_last;      /* reading of the last consumed cycle */
+#endif
+
+/* Upper 16 bits of the capture timebase (TIM2 overflows) */
+static volatile uint16_t tim2_ovf;
+
+/* ================= TIMEBASE ================= */
+/**
+ * @brief Returns the 32-bit timebase: TIM2 overflows : TIM2 counter.
+ *
+ * If the counter has wrapped but the update interrupt has not run yet
+ * (UIF still set), the overflow count is one behind; a small counter
+ * value then belongs to the next period.
+ *
+ * @retval uint32_t  Time in MHZ19_TICK_US ticks, wraps every ~4.8 h.
+ *
+ * @note Must be called with interrupts disabled (e.g. from an ISR).
+ */
+static uint32_t mhz19_now(void)
+{
+    uint16_t hi  = tim2_ovf;
+    uint16_t cnt = TIM2_GetCounter();
+
+    if ((TIM2_SR1 & TIM2_SR1_UIF) && cnt < 0x8000u)
+        hi++;
+
+    return ((uint32_t)hi << 16) | cnt;
+}
+
+/**
+ * @brief Records one edge of the PWM signal.
+ *
+ * @param[in] ts      Edge time in ticks.
+ * @param[in] rising  Non-zero for a rising edge.
+ */
+static void mhz19_edge(uint32_t ts, uint8_t rising)
+{
+    uint32_t high;
+    uint32_t period;
+
+    if (rising)
+    {
+        pwm.tLow     = ts - pwm.lastFall;
+        pwm.lastRise = ts;
+        return;
+    }
+
+    high         = ts - pwm.lastRise;
+    period       = high + pwm.tLow;
+    pwm.lastFall = ts;
+
+    /* glitches and missed edges give an implausible cycle: drop it */
+    if (period < MHZ19_PERIOD_MIN || period > MHZ19_PERIOD_MAX ||
+        high < MHZ19_T2MS || pwm.tLow < MHZ19_T2MS)
+        return;
+
+    cycle.seq++;
+    cycle.high   = high;
+    cycle.period = period;
+    cycle.count++;
+    cycle.seq++;
+}
+
+/**
+ * @brief Copies the last validated cycle without masking interrupts.
+ *
+ * @param[out] high    High time in ticks.
+ * @param[out] period  Period in ticks.
+ *
+ * @retval uint8_t  Validated-cycle counter at the time of the copy.
+ */
+static uint8_t mhz19_snapshot(uint32_t *high, uint32_t *period)
+{
+    uint8_t seq;
+    uint8_t count;
+
+    do {
+        seq     = cycle.seq;
+        *high   = cycle.high;
+        *period = cycle.period;
+        count   = cycle.count;
+    } while ((seq & 1u) || seq != cycle.seq);
+
+    return count;
+}
+
+/**
+ * @brief Calculates ppm from one PWM cycle.
+ *
+ * ppm = 5000 * (Th - 2 ms) / (T - 4 ms). Near the nominal period this is
+ * evaluated as (Th - 2 ms) / 50 with a first-order correction for the
+ * period deviation d = T - 1004 ms:
+ *
+ *   ppm ~= base * (1 - d / 250000),  base = (Th - 2 ms) / 50
+ *
+ * using multiplications by reciprocals only. The error against the
+ * exact formula is below 3 ppm within ±2 % of nominal (0.6 ppm at the
+ * nominal period); other periods use the exact 32-bit divide.
+ *
+ * @param[in] Th  High time in ticks.
+ * @param[in] T   Period in ticks (validated by mhz19_edge()).
+ *
+ * @retval uint16_t  CO2 concentration, 0 ... 5000 ppm.
+ */
+static uint16_t mhz19_cycle_ppm(uint32_t Th, uint32_t T)
+{
+    uint32_t x = Th - MHZ19_T2MS;
+    uint32_t ppm;
+    uint32_t corr;
+    uint32_t dev;
+
+    dev = (T >= MHZ19_PERIOD_NOM) ? T - MHZ19_PERIOD_NOM : MHZ19_PERIOD_NOM - T;
+
+    if (dev > MHZ19_FAST_DEV)
+    {
+        ppm = 5000UL * x / (T - MHZ19_T4MS);
+    }
+    else
+    {
+        ppm  = (x * MHZ19_DIV50_MUL + (1UL << (MHZ19_DIV50_SHIFT - 1))) >> MHZ19_DIV50_SHIFT;
+
+        /* ppm * dev / 250000; ppm * dev < 2^25, pre-shift keeps it in 32 bits */
+        corr = (((ppm * dev) >> 6) * MHZ19_SPAN_MUL + (1UL << 23)) >> 24;
+
+        if (T < MHZ19_PERIOD_NOM)
+            ppm += corr;
+        else
+            ppm = (corr > ppm) ? 0 : ppm - corr;
+    }
+
+    if (ppm > 5000)
+        ppm = 5000;
+
+    return (uint16_t)ppm;
+}
+
+#if MHZ19_FILTER_LEN
+/**
+ * @brief Returns the median of the readings in the filter ring.
+ *
+ * @retval uint16_t  Median of the first `ppm_fill` entries.
+ */
+static uint16_t mhz19_median(void)
+{
+    uint16_t v[MHZ19_FILTER_LEN];
+    uint16_t x;
+    uint8_t i, j;
+
+    /* insertion sort of at most MHZ19_FILTER_LEN values */
+    for (i = 0; i < ppm_fill; i++) {
+        x = ppm_ring[i];
+        for (j = i; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+        v[j] = x;
+    }
+
+    return v[ppm_fill >> 1];
+}
+#endif
+
 /* ================= INIT ================= */
-void MHZ19_PWM_Init(void)
+void MHZ19_Init(void)
 {
     pwm.lastRise = 0;
     pwm.lastFall = 0;
-    pwm.tHigh    = 0;
     pwm.tLow     = 0;
-    pwm.ready    = 0;
+    cycle.count  = 0;
+    ppm_count    = 0;
+#if MHZ19_FILTER_LEN
+    ppm_fill     = 0;
+    ppm_idx      = 0;
+    ppm_ema_x8   = 0;
+#else
+    ppm_last     = 0;
+#endif
+    tim2_ovf     = 0;
 
-    /* TIM2 = timebase (~1 µs @16 MHz) */
-    TIM2_DeInit();
-    TIM2_TimeBaseInit(TIM2_PRESCALER_16, 0xFFFF);
-    TIM2_Cmd(ENABLE);
+    /* the PWM period is measured continuously: TIM2 must never stop */
+    power_lock(POWER_LOCK_CAPTURE);
+
+    /* TIM2 = free-running timebase, overflows counted in the update ISR;
+       called once after reset, so the other TIM2 registers hold reset values */
+    TIM2_TimeBaseInit(MHZ19_TIM2_PRESCALER, 0xFFFF);
+    TIM2_PrescalerConfig(MHZ19_TIM2_PRESCALER, TIM2_PSCRELOADMODE_IMMEDIATE);
+    TIM2_ClearITPendingBit(TIM2_IT_UPDATE);
+    TIM2_ITConfig(TIM2_IT_UPDATE, ENABLE);
 
-    /* GPIO input + EXTI */
+    /* GPIO input, floating */
     MHZ19_PWM_PORT->DDR &= ~(1 << MHZ19_PWM_PIN);
     MHZ19_PWM_PORT->CR1 &= ~(1 << MHZ19_PWM_PIN);
+
+#if MHZ19_BACKEND == MHZ19_BACKEND_IC
+    /* IC2 <- TI2 rising, IC1 <- TI2 falling: both edges latched in hardware */
+    MHZ19_PWM_PORT->CR2 &= ~(1 << MHZ19_PWM_PIN);
+
+    TIM2_ICInit(TIM2_CHANNEL_2, TIM2_ICPOLARITY_RISING,
+                TIM2_ICSELECTION_DIRECTTI, TIM2_ICPSC_DIV1, MHZ19_IC_FILTER);
+    TIM2_ICInit(TIM2_CHANNEL_1, TIM2_ICPOLARITY_FALLING,
+                TIM2_ICSELECTION_INDIRECTTI, TIM2_ICPSC_DIV1, MHZ19_IC_FILTER);
+
+    TIM2_SR2 = 0;
+    TIM2_ClearITPendingBit((TIM2_IT_TypeDef)(TIM2_IT_CC1 | TIM2_IT_CC2));
+    TIM2_ITConfig((TIM2_IT_TypeDef)(TIM2_IT_CC1 | TIM2_IT_CC2), ENABLE);
+    TIM2_Cmd(ENABLE);
+#else
+    TIM2_Cmd(ENABLE);
+
+    /* EXTI on both edges, timestamped in the ISR */
     MHZ19_PWM_PORT->CR2 |=  (1 << MHZ19_PWM_PIN);
 
     disableInterrupts();
     EXTI_SetExtIntSensitivity(MHZ19_EXTI_PORT, EXTI_SENSITIVITY_RISE_FALL);
     enableInterrupts();
+#endif
 }
 
 /* ================= CO2 ================= */
-uint16_t MHZ19_PWM_GetPPM(void)
+uint16_t MHZ19_GetPPM(void)
 {
     uint32_t Th;
-    uint32_t Tl;
-    uint32_t ppm;
+    uint32_t T;
+    uint8_t count;
 
-    if (!pwm.ready)
-        return 0;
+    count = mhz19_snapshot(&Th, &T);
 
-    disableInterrupts();
-    Th = pwm.tHigh;
-    Tl = pwm.tLow;
-    pwm.ready = 0;
-    enableInterrupts();
+#if MHZ19_FILTER_LEN
+    if (count == ppm_count)
+        return (uint16_t)((ppm_ema_x8 + 4u) >> 3);
+    ppm_count = count;
 
-    if (Th < 2000 || (Th + Tl) < 4000)
-        return 0;
+    ppm_ring[ppm_idx] = mhz19_cycle_ppm(Th, T);
+    if (++ppm_idx >= MHZ19_FILTER_LEN) ppm_idx = 0;
+    if (ppm_fill < MHZ19_FILTER_LEN)   ppm_fill++;
 
-    ppm = 5000UL * (Th - 2000) / (Th + Tl - 4000);
+    /* EMA, alpha = 1/4: e = 3/4 e + 1/4 x, kept * 8 */
+    if (ppm_fill == 1)
+        ppm_ema_x8 = (uint16_t)(mhz19_median() << 3);
+    else
+        ppm_ema_x8 = (uint16_t)(ppm_ema_x8 - (ppm_ema_x8 >> 2) + (mhz19_median() << 1));
 
-    if (ppm > 5000)
-        ppm = 5000;
+    return (uint16_t)((ppm_ema_x8 + 4u) >> 3);
+#else
+    if (count != ppm_count)
+    {
+        ppm_count = count;
+        ppm_last  = mhz19_cycle_ppm(Th, T);
+    }
 
-    return (uint16_t)ppm;
+    return ppm_last;
+#endif
 }
 
-/* ================= EXTI ISR ================= */
-INTERRUPT_HANDLER(EXTI_PORTD_IRQHandler, 6)
+/* ================= TIMING ================= */
+uint8_t MHZ19_PWM_GetTiming(uint32_t *high_ticks, uint32_t *period_ticks)
 {
-    uint16_t now = ((uint16_t)TIM2_CNTRH << 8) | TIM2_CNTRL;
+    return mhz19_snapshot(high_ticks, period_ticks);
+}
 
-    if (MHZ19_PWM_PORT->IDR & (1 << MHZ19_PWM_PIN))
-    {
-        pwm.tLow     = now - pwm.lastFall;
-        pwm.lastRise = now;
-    }
-    else
+/* ================= TIM2 ISR ================= */
+INTERRUPT_HANDLER(TIM2_UPD_OVF_IRQHandler, 13)
+{
+    TIM2_ClearITPendingBit(TIM2_IT_UPDATE);
+    tim2_ovf++;
+}
+
+#if MHZ19_BACKEND == MHZ19_BACKEND_IC
+/* ================= CAPTURE ISR ================= */
+INTERRUPT_HANDLER(TIM2_CAP_COM_IRQHandler, 14)
+{
+    uint8_t  sr;
+    uint32_t now;
+    uint16_t lo;
+    uint16_t ageR = 0;
+    uint16_t ageF = 0;
+
+    PROF_BEGIN(PROF_CO2_ISR);
+    sr  = TIM2_SR1;
+    now = mhz19_now();
+    lo  = (uint16_t)now;
+
+    /* capture -> 32-bit time: valid while the edge is < 262 ms old */
+    if (sr & TIM2_SR1_CC2IF) ageR = (uint16_t)(lo - TIM2_GetCapture2());
+    if (sr & TIM2_SR1_CC1IF) ageF = (uint16_t)(lo - TIM2_GetCapture1());
+    TIM2_SR2 = 0;
+
+    /* both edges pending: the older one first */
+    if ((sr & TIM2_SR1_CC1IF) && (!(sr & TIM2_SR1_CC2IF) || ageF > ageR))
     {
-        pwm.tHigh    = now - pwm.lastRise;
-        pwm.lastFall = now;
-        pwm.ready    = 1;
+        mhz19_edge(now - ageF, 0);
+        sr &= (uint8_t)~TIM2_SR1_CC1IF;
     }
+    if (sr & TIM2_SR1_CC2IF)
+        mhz19_edge(now - ageR, 1);
+    if (sr & TIM2_SR1_CC1IF)
+        mhz19_edge(now - ageF, 0);
+    PROF_END(PROF_CO2_ISR);
 }
+#else
+/* ================= EXTI ISR ================= */
+INTERRUPT_HANDLER(EXTI_PORTD_IRQHandler, 6)
+{
+    PROF_BEGIN(PROF_CO2_ISR);
+    mhz19_edge(mhz19_now(),
+               (MHZ19_PWM_PORT->IDR & (1 << MHZ19_PWM_PIN)) ? 1 : 0);
+    PROF_END(PROF_CO2_ISR);
+}
+#endif
+
+#endif /* MHZ19_BACKEND != MHZ19_BACKEND_UART */
@@ -0,0 +1,245 @@
+#include "mh-z19b.h"
+#include "stm8_s.h"
+#include "uart_driver.h"
+#include "clock.h"
+#include "power.h"
+#include "systick.h"
+
+/* UART backend; the PWM backends are in mh-z19b.c */
+#if MHZ19_BACKEND == MHZ19_BACKEND_UART
+
+#if !UART1_RX_IRQ
+#error "MHZ19_BACKEND_UART needs UART1_RX_IRQ=1"
+#endif
+
+/* ================= PROTOCOL ================= */
+#define MHZ19_FRAME_LEN   9
+#define MHZ19_START       0xFF
+#define MHZ19_SENSOR      0x01   /* sensor number in requests */
+
+#define MHZ19_CMD_READ    0x86
+#define MHZ19_CMD_ABC     0x79
+#define MHZ19_CMD_RANGE   0x99
+
+#define MHZ19_ABC_ON      0xA0
+#define MHZ19_ABC_OFF     0x00
+
+/* ================= STATE ================= */
+/* Frame being assembled by the RX interrupt */
+static uint8_t rx_frame[MHZ19_FRAME_LEN];
+static uint8_t rx_len;
+
+/*
+ * Last valid reading, written by the RX interrupt and read by the main
+ * loop under a sequence counter (odd while the ISR is writing).
+ */
+typedef struct {
+    volatile uint8_t  seq;
+    volatile uint16_t ppm;
+    volatile uint16_t errors;
+} MHZ19_UART_State_t;
+
+static MHZ19_UART_State_t sensor;
+
+/* A reply to the last request is expected (holds POWER_LOCK_UART); cleared by the RX interrupt */
+static volatile uint8_t reply_pending;
+
+/* millis() after which the expected reply is given up */
+static uint32_t reply_deadline;
+
+/* Requests that got no reply in time (main loop only) */
+static uint16_t reply_timeouts;
+
+/* ================= FRAMES ================= */
+/**
+ * @brief Calculates the checksum of a 9-byte frame.
+ *
+ * Two's complement of the sum of bytes 1 ... 7.
+ *
+ * @param[in] frame  Frame of MHZ19_FRAME_LEN bytes.
+ *
+ * @retval uint8_t  Value expected in byte 8.
+ */
+static uint8_t mhz19_checksum(const uint8_t *frame)
+{
+    uint8_t sum = 0;
+    uint8_t i;
+
+    for (i = 1; i < MHZ19_FRAME_LEN - 1; i++)
+        sum += frame[i];
+
+    return (uint8_t)(~sum + 1);
+}
+
+/**
+ * @brief Sends a command frame.
+ *
+ * @param[in] cmd  Command byte.
+ * @param[in] b3   Data byte 3.
+ * @param[in] b6   Data byte 6.
+ * @param[in] b7   Data byte 7.
+ *
+ * @note Blocks for the frame time (~9.4 ms at 9600 baud).
+ */
+static void mhz19_command(uint8_t cmd, uint8_t b3, uint8_t b6, uint8_t b7)
+{
+    uint8_t frame[MHZ19_FRAME_LEN];
+    uint8_t i;
+
+    frame[0] = MHZ19_START;
+    frame[1] = MHZ19_SENSOR;
+    frame[2] = cmd;
+    frame[3] = b3;
+    frame[4] = 0;
+    frame[5] = 0;
+    frame[6] = b6;
+    frame[7] = b7;
+    frame[8] = mhz19_checksum(frame);
+
+    for (i = 0; i < MHZ19_FRAME_LEN; i++)
+        UART1_SendChar((char)frame[i]);
+}
+
+/**
+ * @brief Counts a dropped frame (RX interrupt).
+ */
+static void mhz19_rx_error(void)
+{
+    sensor.seq++;
+    sensor.errors++;
+    sensor.seq++;
+    rx_len = 0;
+    reply_pending = 0;
+    power_unlock(POWER_LOCK_UART);
+}
+
+/**
+ * @brief Gives up the expected reply: counts a timeout and releases the lock.
+ */
+static void mhz19_reply_drop(void)
+{
+    uint8_t cc;
+
+    ENTER_CRITICAL(cc);
+    if (reply_pending)
+    {
+        reply_pending = 0;
+        rx_len = 0;     // a partial frame would be joined to the next reply
+        reply_timeouts++;
+        power_unlock(POWER_LOCK_UART);
+    }
+    EXIT_CRITICAL(cc);
+}
+
+/**
+ * @brief Collects response frames byte by byte (UART1 RX interrupt).
+ *
+ * Resynchronises on the 0xFF start byte; a complete frame with a valid
+ * checksum and the read command updates the published reading.
+ *
+ * @param[in] byte   Received byte.
+ * @param[in] error  Receive error flags for this byte.
+ */
+static void mhz19_rx(uint8_t byte, uint8_t error)
+{
+    if (error)
+    {
+        mhz19_rx_error();
+        return;
+    }
+
+    if (rx_len == 0 && byte != MHZ19_START)
+        return;
+
+    rx_frame[rx_len++] = byte;
+    if (rx_len < MHZ19_FRAME_LEN)
+        return;
+
+    rx_len = 0;
+    reply_pending = 0;
+    power_unlock(POWER_LOCK_UART);
+
+    if (rx_frame[8] != mhz19_checksum(rx_frame))
+    {
+        mhz19_rx_error();
+        return;
+    }
+
+    if (rx_frame[1] == MHZ19_CMD_READ)
+    {
+        sensor.seq++;
+        sensor.ppm = (uint16_t)(((uint16_t)rx_frame[2] << 8) | rx_frame[3]);
+        sensor.seq++;
+    }
+}
+
+/* ================= API ================= */
+void MHZ19_Init(void)
+{
+    rx_len         = 0;
+    sensor.ppm     = 0;
+    sensor.errors  = 0;
+    reply_pending  = 0;
+    reply_timeouts = 0;
+
+    UART1_Init(clock_hz(), MHZ19_UART_BAUD);
+    UART1_SetRxHandler(mhz19_rx);
+}
+
+uint16_t MHZ19_GetPPM(void)
+{
+    uint8_t  seq;
+    uint16_t ppm;
+
+    do {
+        seq = sensor.seq;
+        ppm = sensor.ppm;
+    } while ((seq & 1u) || seq != sensor.seq);
+
+    // the previous request is still unanswered: give it up
+    mhz19_reply_drop();
+
+    // no halt until the reply is in: UART1 stops with the main clock
+    reply_pending = 1;
+    power_lock(POWER_LOCK_UART);
+    mhz19_command(MHZ19_CMD_READ, 0, 0, 0);
+    reply_deadline = millis() + MHZ19_REPLY_TIMEOUT_MS;
+
+    return ppm;
+}
+
+void MHZ19_Poll(void)
+{
+    if (reply_pending && TIME_REACHED(millis(), reply_deadline))
+        mhz19_reply_drop();
+}
+
+uint16_t MHZ19_GetTimeouts(void)
+{
+    return reply_timeouts;
+}
+
+void MHZ19_SetABC(uint8_t enable)
+{
+    mhz19_command(MHZ19_CMD_ABC, enable ? MHZ19_ABC_ON : MHZ19_ABC_OFF, 0, 0);
+}
+
+void MHZ19_SetRange(uint16_t range_ppm)
+{
+    mhz19_command(MHZ19_CMD_RANGE, 0, (uint8_t)(range_ppm >> 8), (uint8_t)range_ppm);
+}
+
+uint16_t MHZ19_GetFrameErrors(void)
+{
+    uint8_t  seq;
+    uint16_t errors;
+
+    do {
+        seq    = sensor.seq;
+        errors = sensor.errors;
+    } while ((seq & 1u) || seq != sensor.seq);
+
+    return errors;
+}
+
+#endif /* MHZ19_BACKEND == MHZ19_BACKEND_UART */
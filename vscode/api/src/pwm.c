@@ -1,11 +1,15 @@
 #include "pwm.h"
 #include "tim1_driver.h"
+#include "systick.h"
+
+/* Empty unless the TIM1 PWM functions are built */
+#if TIM1_PWM_ENABLE
 
 static uint8_t buzzer_state=0;//<Current buzzer state
-static uint32_t buzzer_timer=0;//<Internal timing counter
+static uint32_t buzzer_timer=0;//<millis() at the start of the current ON/OFF phase
 static uint16_t buzzer_on_ms=0;//<Buzzer ON duration in milliseconds
 static uint16_t buzzer_off_ms=0;//<Buzzer OFF duration in milliseconds
-static uint16_t buzzer_duty=0;//<PWM duty cycle used when the buzzer is ON
+static uint16_t buzzer_duty=0;//<PWM duty cycle used when the buzzer is ON, per mille
 
 //Initializes the buzzer PWM subsystem
 void Buzzer_Init(uint8_t channel, uint16_t period, uint16_t prescaler){
@@ -18,36 +22,36 @@ void Buzzer_Init(uint8_t channel, uint16_t period, uint16_t prescaler){
 void Buzzer_Start(uint16_t freq, uint16_t duty, uint16_t on_ms, uint16_t off_ms)
 {
     buzzer_state = 0;
-    buzzer_timer = 0;
+    buzzer_timer = millis();
     buzzer_duty = duty;
     buzzer_on_ms = on_ms;
     buzzer_off_ms = off_ms;
 
-    TIM1_PWM_SetFrequency(4, 0, freq);
-    TIM1_PWM_SetDuty(4, 0);
+    TIM1_PWM_SetDuty(4, 0); // silent until the first ON phase
+    TIM1_PWM_SetFrequency(4, freq); // the duty is scaled to the new period when the ON phase starts
     TIM1_Start();
 }
 
 //Updates the buzzer state machine
 void Buzzer_Update(void)
 {
-    buzzer_timer++;
+    uint32_t now = millis();
 
     if(buzzer_state==0)
     {
-        if(buzzer_timer>=buzzer_off_ms)
+        if(TIME_SINCE(now, buzzer_timer)>=buzzer_off_ms)
         {
-            TIM1_PWM_SetDuty(4, buzzer_duty);
-            buzzer_timer=0;
+            TIM1_PWM_SetDutyPermille(4, buzzer_duty);
+            buzzer_timer=now;
             buzzer_state=1;
         }
     }
     else
     {
-        if(buzzer_timer>=buzzer_on_ms)
+        if(TIME_SINCE(now, buzzer_timer)>=buzzer_on_ms)
         {
             TIM1_PWM_SetDuty(4, 0);
-            buzzer_timer=0;
+            buzzer_timer=now;
             buzzer_state=0;
         }
     }
@@ -59,4 +63,6 @@ void Buzzer_Stop(void)
     TIM1_PWM_SetDuty(4,0);
     TIM1_Stop();
     buzzer_state=0;
-}
\ No newline at end of file
+}
+
+#endif /* TIM1_PWM_ENABLE */
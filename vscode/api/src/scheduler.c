@@ -0,0 +1,125 @@
+#include "scheduler.h"
+#include "systick.h"
+#include "prof.h"
+
+
+/* Task table and state set by sched_init() */
+static const sched_task_t *sched_tasks = 0;
+static sched_state_t *sched_state = 0;
+static uint8_t sched_count = 0;
+
+
+//Sets up the scheduler
+void sched_init(const sched_task_t *tasks, sched_state_t *state, uint8_t count)
+{
+    uint32_t now = millis();
+    uint8_t i;
+
+    sched_tasks = tasks;
+    sched_state = state;
+    sched_count = count;
+
+    for (i = 0; i < count; i++)
+    {
+        state[i].next_ms  = now;
+        state[i].overruns = 0;
+#if SCHED_STATS
+        state[i].runs     = 0;
+#endif
+    }
+}
+
+//Runs every released task once
+uint8_t sched_run(void)
+{
+    sched_state_t *st;
+    uint32_t now;
+    uint32_t deadline;
+    uint8_t ran = 0;
+    uint8_t i;
+
+    for (i = 0; i < sched_count; i++)
+    {
+        st = &sched_state[i];
+        if (!TIME_REACHED(millis(), st->next_ms)) continue;
+
+        deadline = st->next_ms + sched_tasks[i].period_ms;
+
+        // release the next period before running: the task may call sched_wake_in()
+        st->next_ms = deadline;
+        PROF_BEGIN(PROF_TASK(i));
+        sched_tasks[i].run();
+        PROF_END(PROF_TASK(i));
+
+        now = millis();
+#if SCHED_STATS
+        st->runs++;
+#endif
+
+        // overrun (finished past the deadline): missed periods are dropped,
+        // not run back to back, unless the task moved its release itself
+        if (!TIME_REACHED(deadline, now))
+        {
+            st->overruns++;
+            if (st->next_ms == deadline) st->next_ms = now + sched_tasks[i].period_ms;
+        }
+
+        ran++;
+    }
+
+    return ran;
+}
+
+//Returns the earliest release time of all tasks
+uint32_t sched_next_release(void)
+{
+    uint32_t next;
+    uint8_t i;
+
+    if (!sched_count) return millis() + 0x7FFFFFFFUL;
+
+    next = sched_state[0].next_ms;
+    for (i = 1; i < sched_count; i++)
+        if (TIME_REACHED(next, sched_state[i].next_ms)) next = sched_state[i].next_ms;
+
+    return next;
+}
+
+//Moves the next release of a task
+void sched_wake_in(uint8_t id, uint16_t ms)
+{
+    if (id >= sched_count) return;
+
+    sched_state[id].next_ms = millis() + ms;
+}
+
+//Returns the overrun count of a task
+uint16_t sched_overruns(uint8_t id)
+{
+    if (id >= sched_count) return 0;
+
+    return sched_state[id].overruns;
+}
+
+#if SCHED_STATS
+//Copies the statistics of a task
+void sched_get_stats(uint8_t id, sched_stats_t *out)
+{
+    if (id >= sched_count) return;
+
+    out->runs     = sched_state[id].runs;
+    out->overruns = sched_state[id].overruns;
+}
+
+//Clears the statistics of all tasks
+void sched_reset_stats(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < sched_count; i++)
+    {
+        sched_state[i].runs     = 0;
+        sched_state[i].overruns = 0;
+    }
+}
+#endif
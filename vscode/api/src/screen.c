@@ -0,0 +1,122 @@
+#include "screen.h"
+#include "lcd_api.h"
+
+
+/* Page being shown */
+static const screen_page_t *screen_cur = 0;
+
+/* Last drawn value of each field of the current page, in shown digits */
+static int16_t screen_last[SCREEN_MAX_FIELDS];
+
+
+/**
+ * @brief Rounds a source value to the field's shown resolution.
+ *
+ * Rounds half away from zero to whole steps, e.g. 2345 with step 10
+ * gives 235 (shown as "23.5" with 1 decimal).
+ *
+ * @param[in] f      Field.
+ * @param[in] value  Source value.
+ *
+ * @retval int16_t  value / step, rounded; SCREEN_NO_VALUE is kept.
+ */
+static int16_t screen_quantize(const screen_field_t *f, int16_t value)
+{
+    uint16_t mag;
+
+    if (value == SCREEN_NO_VALUE || f->step <= 1) return value;
+
+    // magnitude + step / 2 fits in 16 bits unsigned
+    mag = (uint16_t)(value < 0 ? -value : value);
+    mag = (uint16_t)((mag + f->step / 2u) / f->step);
+    return value < 0 ? -(int16_t)mag : (int16_t)mag;
+}
+
+/**
+ * @brief Draws the value of a field.
+ *
+ * The value is shown with the field's number of decimals;
+ * SCREEN_NO_VALUE is shown as dashes.
+ *
+ * @param[in] f  Field.
+ * @param[in] q  Value rounded by screen_quantize().
+ */
+static void screen_draw_value(const screen_field_t *f, int16_t q)
+{
+    const char *p;
+    uint8_t col = f->col;
+    uint8_t i;
+
+    if (f->label)
+        for (p = f->label; *p; p++) col++;
+
+    lcd_put_cur(f->row, col);
+
+    if (q == SCREEN_NO_VALUE)
+    {
+        for (i = 0; i < f->width || i == 0; i++) lcd_send_char('-');
+        return;
+    }
+
+    lcd_send_fixed(q, f->decimals, f->width);
+}
+
+//Switches to a page
+void screen_show(const screen_page_t *page)
+{
+    const screen_field_t *f;
+    uint8_t i;
+
+    screen_cur = page;
+    lcd_clear();
+
+    for (i = 0; i < page->count && i < SCREEN_MAX_FIELDS; i++)
+    {
+        f = &page->fields[i];
+
+        if (f->label)
+        {
+            lcd_put_cur(f->row, f->col);
+            lcd_send_string((char *)f->label);
+        }
+
+        if (f->source)
+        {
+            screen_last[i] = screen_quantize(f, f->source());
+            screen_draw_value(f, screen_last[i]);
+        }
+    }
+}
+
+//Redraws the fields of the current page whose value changed
+uint8_t screen_update(void)
+{
+    const screen_field_t *f;
+    int16_t q;
+    uint8_t drawn = 0;
+    uint8_t i;
+
+    if (!screen_cur) return 0;
+
+    for (i = 0; i < screen_cur->count && i < SCREEN_MAX_FIELDS; i++)
+    {
+        f = &screen_cur->fields[i];
+        if (!f->source) continue;
+
+        // redrawn only when the shown digits change
+        q = screen_quantize(f, f->source());
+        if (q == screen_last[i]) continue;
+
+        screen_last[i] = q;
+        screen_draw_value(f, q);
+        drawn++;
+    }
+
+    return drawn;
+}
+
+//Returns the page currently shown
+const screen_page_t *screen_page(void)
+{
+    return screen_cur;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file clock.h
+ * @brief Runtime CPU clock scaling with peripheral re-timing.
+ *
+ * The master clock fMASTER comes from the 16 MHz HSI through the HSI
+ * divider (CLK_CKDIVR). Four profiles are supported:
+ *
+ *   profile      fMASTER   CKDIVR  TIM2/TIM4 prescaler
+ *   CLOCK_16MHZ  16 MHz    0x00    /64
+ *   CLOCK_8MHZ    8 MHz    0x08    /32
+ *   CLOCK_4MHZ    4 MHz    0x10    /16
+ *   CLOCK_2MHZ    2 MHz    0x18    /8
+ *
+ * The profile table is computed at compile time. The timer prescalers
+ * keep 4 us per count in every profile, so the 1 ms system tick
+ * (systick.h) and the MH-Z19B capture timebase are not affected by a
+ * switch. The I2C (FREQR, CCR, TRISE) and UART (BRR) settings depend
+ * on the bus speed chosen at run time; i2c_master_init() and
+ * UART1_Init() compute them once for every profile, so clock_set()
+ * only copies precomputed values into the registers.
+ *
+ * Switching at run time is only built with CLOCK_SCALING_ENABLE = 1;
+ * otherwise the boot profile of clock_init() is kept and clock_set(),
+ * the per-profile I2C / UART tables and the timer re-timing are left
+ * out. clock_set() re-times UART1, so the scaling build also needs
+ * uart_driver.o in temp.lkf.
+ *
+ * Scaling is off by default for flash: it adds about 940 bytes of code
+ * (host gcc -Os build of the temp.lkf objects: clock.c +235,
+ * i2c_driver.c +176, systick.c +59, tim2_driver.c +74, main.c +22 and
+ * uart_driver.o 371), which does not fit beside the default feature set
+ * in the 8 KB part. The gain is also small: the CPU spends most of
+ * its idle time in WFI (power.h), where the core is already stopped.
+ *
+ * `clock_set()` refuses to switch while a bus is in use: an I2C
+ * transaction is queued or running, a UART byte is being sent, or a
+ * UART reply is expected (POWER_LOCK_UART).
+ *
+ * @note TIM1 (buzzer PWM) is not re-timed: its output frequency scales
+ *       with fMASTER until TIM1_PWM_SetFrequency() is called again.
+ * @note DELAY_US() constants are computed for F_CPU; at a lower clock
+ *       they wait proportionally longer, never shorter.
+ *
+ * @date 2026-02-04
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include "stm8_s.h"
+
+/* 1 = build clock_set() and the peripheral re-timing */
+#ifndef CLOCK_SCALING_ENABLE
+#define CLOCK_SCALING_ENABLE 0
+#endif
+
+/* Clock profiles: HSI divided by 2^profile */
+#define CLOCK_16MHZ 0u
+#define CLOCK_8MHZ  1u
+#define CLOCK_4MHZ  2u
+#define CLOCK_2MHZ  3u
+#define CLOCK_COUNT 4u
+
+/* clock_set() status codes */
+#define CLOCK_OK          0
+#define CLOCK_ERR_BUSY  (-1)  /* A bus transfer is in progress */
+#define CLOCK_ERR_ARG   (-2)  /* Unknown profile */
+
+/* fMASTER of a profile, Hz (F_CPU is the undivided HSI clock) */
+#define CLOCK_PROFILE_HZ(id) (F_CPU >> (id))
+
+/* TIM2/TIM4 prescaler exponent giving 4 us counts in a profile */
+#define CLOCK_TIMER_PSC(id) ((uint8_t)(6u - (id)))
+
+/**
+ * @brief Selects the boot clock profile.
+ *
+ * Only programs the HSI divider; call it first in main(), before the
+ * peripheral drivers are initialized with clock_hz().
+ *
+ * @param[in] id  CLOCK_16MHZ ... CLOCK_2MHZ.
+ */
+void clock_init(uint8_t id);
+
+#if CLOCK_SCALING_ENABLE
+/**
+ * @brief Switches to another clock profile and re-times the peripherals.
+ *
+ * With interrupts masked, changes the HSI divider, the TIM4 (system
+ * tick) and TIM2 (capture timebase) prescalers, and loads the I2C and
+ * UART settings precomputed for the new profile. Timer counts are kept
+ * across the switch.
+ *
+ * @param[in] id  CLOCK_16MHZ ... CLOCK_2MHZ.
+ *
+ * @retval CLOCK_OK        Switched, or already in this profile.
+ * @retval CLOCK_ERR_BUSY  A bus transfer is in progress, try again later.
+ * @retval CLOCK_ERR_ARG   Unknown profile.
+ */
+int8_t clock_set(uint8_t id);
+#endif
+
+/**
+ * @brief Returns the current clock profile.
+ *
+ * @retval uint8_t  CLOCK_16MHZ ... CLOCK_2MHZ.
+ */
+uint8_t clock_id(void);
+
+/**
+ * @brief Returns the current master clock frequency.
+ *
+ * @retval uint32_t  fMASTER in Hz.
+ */
+uint32_t clock_hz(void);
+
+#if CLOCK_SCALING_ENABLE
+/**
+ * @brief Returns the master clock frequency of a profile.
+ *
+ * @param[in] id  CLOCK_16MHZ ... CLOCK_2MHZ.
+ *
+ * @retval uint32_t  fMASTER in Hz, 0 for an unknown profile.
+ */
+uint32_t clock_profile_hz(uint8_t id);
+#endif
+
+/**
+ * @brief Returns the TIM2/TIM4 prescaler for the current profile.
+ *
+ * @retval uint8_t  Prescaler exponent: the timers count at fMASTER / 2^n,
+ *                  i.e. every 4 us.
+ */
+uint8_t clock_timer_psc(void);
+
+#endif
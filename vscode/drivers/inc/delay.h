@@ -2,11 +2,27 @@
  * @file delay.h
  * @brief Blocking delay driver based on CPU clock frequency.
  *
- * This driver implements simple blocking delays using busy-wait loops.
- * Delay duration is calculated from the CPU clock frequency (F_CPU).
+ * This driver implements simple blocking delays.
  *
- * The driver does not use hardware timers and therefore blocks CPU
- * execution for the entire delay period.
+ * Once the system tick runs (systick.h) and interrupts are enabled,
+ * `delay_ms()` is timed by `micros()` and the CPU sleeps (WFI) between
+ * interrupts. Before that, and for short microsecond waits, a counted
+ * assembly loop of 4 CPU cycles per pass is used.
+ *
+ * The loop timings are estimates: the cycle counts are taken from the
+ * PM0044 instruction table and have not been measured on the target
+ * (no STM8 simulator or scope trace was available). Pipeline stalls or
+ * branch alignment can only add cycles: with 5 cycles per pass the
+ * waits come out 25 % long, never short. Check with a scope where the
+ * upper bound matters.
+ *
+ * For constant microsecond waits use the `DELAY_US()` macro: the pass
+ * count, including the call overhead, is folded into a constant at
+ * compile time from F_CPU. `delay_us()` takes runtime values.
+ *
+ * After clock_set() to a lower profile (clock.h), `DELAY_US()` waits
+ * proportionally longer, never shorter; `delay_us()` scales its pass
+ * count to the current clock.
  *
  * @note Intended for simple timing needs during initialization,
  *       debugging, or low-priority delays.
@@ -19,30 +35,77 @@
 #define DELAY_H
 
 #include <stdint.h>
+#include "stm8_s.h"
+
+/* CPU cycles per microsecond */
+#define DELAY_CYCLES_PER_US (F_CPU / 1000000UL)
+
+/*
+ * Cycles of a delay_loops() call outside the loop passes (PM0044 counts,
+ * not measured):
+ * ldw x,#n (2) + call (4) + tnzw x (1) + jreq (1) + ret (4), minus one
+ * for the last jrne, which is not taken.
+ */
+#define DELAY_CALL_CYCLES 11UL
+
+/* Loop passes for `us` microseconds, call included, rounded (at least 1) */
+#define DELAY_US_LOOPS(us) \
+    ((uint16_t)(((unsigned long)(us) * DELAY_CYCLES_PER_US > DELAY_CALL_CYCLES + 4UL) ? \
+        (((unsigned long)(us) * DELAY_CYCLES_PER_US - DELAY_CALL_CYCLES + 2UL) / 4UL) : 1UL))
+
+/*
+ * Cycle-counted delay for a constant number of microseconds,
+ * up to DELAY_US_CHUNK; the pass count is a compile-time constant.
+ */
+#define DELAY_US(us) delay_loops(DELAY_US_LOOPS(us))
+
+/* Longest DELAY_US() argument (65535 passes at 16 MHz is 16.38 ms) */
+#define DELAY_US_CHUNK 10000u
+
+/* delay_us() waits at least this long on micros() when the tick runs */
+#define DELAY_US_TIMER_MIN 50u
 
 /**
  * @brief Creates a blocking delay in milliseconds.
  *
- * This function generates a software delay by executing a calibrated
- * busy-wait loop. The delay length depends on the CPU clock frequency.
+ * With the system tick running and interrupts enabled the delay is
+ * measured with `micros()` (4 us resolution) and the CPU waits in WFI;
+ * interrupt handlers keep running. Otherwise it is built from
+ * `DELAY_US(1000)` steps of the cycle-counted loop.
  *
  * @param ms  Delay time in milliseconds.
  *
- * @warning This function blocks CPU execution.
- * @warning Delay accuracy depends on compiler optimization and F_CPU value.
+ * @warning This function blocks the caller.
  */
 void delay_ms(uint16_t ms);
 
 /**
  * @brief Creates a blocking delay in microseconds.
  *
- * This function generates a short software delay using a busy-wait loop.
+ * Waits of DELAY_US_TIMER_MIN or more are timed with `micros()` when
+ * the system tick runs and interrupts are enabled. Shorter waits, and
+ * all waits before that, use the cycle-counted loop with a pass count
+ * computed at run time for the current clock profile.
  *
  * @param us  Delay time in microseconds.
  *
+ * @note The delay is a minimum: the run-time path adds a few
+ *       microseconds of overhead, interrupts may add more. Use
+ *       `DELAY_US()` for short constant waits.
  * @warning This function blocks CPU execution.
- * @warning Intended only for short, non-critical delays.
  */
 void delay_us(uint16_t us);
 
+/**
+ * @brief Busy-waits for a number of loop passes.
+ *
+ * Each pass of the assembly loop (`nop`, `decw x`, `jrne`) takes
+ * 4 CPU cycles by the PM0044 table; the call adds DELAY_CALL_CYCLES.
+ *
+ * @param n  Number of passes (0 returns at once).
+ *
+ * @note Normally used through `DELAY_US()`.
+ */
+void delay_loops(uint16_t n);
+
 #endif
\ No newline at end of file
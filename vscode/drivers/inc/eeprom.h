@@ -11,6 +11,9 @@
  *
  * The implementation directly accesses FLASH control registers.
  *
+ * @note Not used by the firmware, so eeprom.o is not in temp.lkf; add it
+ *       there together with the first caller.
+ *
  * @date 2026-01-31
  */
 
@@ -13,6 +13,9 @@
  *  - Push-pull / Open-drain output modes
  *  - Pull-up / Floating input modes
  *  - Pin state caching
+ *
+ * @note Not used by the firmware, so gpio_driver.o is not in temp.lkf;
+ *       add it there together with the first caller.
  * 
  * @date 2026-02-03
  * 
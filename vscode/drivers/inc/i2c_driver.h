@@ -2,21 +2,36 @@
  * @file i2c_driver.h
  * @brief I2C master driver for STM8 microcontrollers.
  *
- * This file provides a blocking I2C master-mode driver implementation
+ * This file provides an I2C master-mode driver implementation
  * for STM8 microcontrollers using direct register access.
  *
  * Supported features:
- *  - I2C master initialization (standard mode, ≤ 100 kHz)
+ *  - I2C master initialization (standard mode ≤ 100 kHz, fast mode ≤ 400 kHz)
  *  - START and STOP condition generation
  *  - 7-bit slave addressing
  *  - Byte-wise transmit and receive operations
  *  - ACK / NACK handling
  *  - Timeout protection to avoid bus lockup
+ *  - Interrupt-driven transaction engine with a request queue
+ *
+ * Transactions are described by ::i2c_xfer_t descriptors (address,
+ * write buffer, read buffer, completion callback) and queued with
+ * i2c_submit(). The I2C interrupt runs them in the background, so the
+ * CPU is free during the transfer. i2c_master_transmit(),
+ * i2c_master_receive() and i2c_master_transfer() are blocking wrappers
+ * around the same engine.
  *
  * The driver is intended for simple sensor and peripheral communication
  * (e.g. EEPROMs, temperature sensors, RTCs).
  *
- * @note Only standard mode (Sm, 100 kHz max) is supported.
+ * @note Standard mode (Sm, ≤ 100 kHz) and fast mode (Fm, ≤ 400 kHz)
+ *       are supported; the bus speed can be derived from the maximum
+ *       speeds of the attached devices with i2c_select_speed().
+ * @note The byte-wise functions (i2c_master_start() ... i2c_master_read_byte())
+ *       are only built with I2C_BYTE_API=1. They poll the hardware
+ *       directly and must only be used while the transaction engine is
+ *       idle (see i2c_busy()).
+ * @note The blocking wrappers need global interrupts to be enabled.
  *
  * 
  * @date 2026-02-03
@@ -26,14 +41,78 @@
 #define I2C_DRIVER_H
 
 #include <stdint.h>
+#include "clock.h"
+
+/* Transaction status codes */
+#define I2C_PENDING       1   /* Queued or in progress */
+#define I2C_OK            0   /* Completed successfully */
+#define I2C_ERR_TIMEOUT (-1)  /* No bus progress within I2C_TIMEOUT_MAX polls */
+#define I2C_ERR_NACK    (-2)  /* Address or data byte not acknowledged */
+#define I2C_ERR_BUS     (-3)  /* Bus error, arbitration lost or overrun */
+#define I2C_ERR_FULL    (-4)  /* Request queue is full */
+
+/* Maximum number of transactions waiting in the request queue */
+#define I2C_QUEUE_LEN 4
+
+/* Set to 1 to build the byte-wise polled functions */
+#ifndef I2C_BYTE_API
+#define I2C_BYTE_API 0
+#endif
+
+/* Set to 1 to count bus activity (see i2c_get_stats(), i2c_bus_hz()) */
+#ifndef I2C_STATS
+#define I2C_STATS 0
+#endif
 
+typedef struct i2c_xfer i2c_xfer_t;
+
+/**
+ * @brief Transaction completion callback.
+ *
+ * Called from the I2C interrupt when the transaction has finished
+ * (successfully or not); `xfer->status` holds the result.
+ */
+typedef void (*i2c_done_cb_t)(i2c_xfer_t *xfer);
+
+/**
+ * @brief I2C transaction descriptor.
+ *
+ * A transaction writes `tx_len` bytes from `tx_buf` and then, if
+ * `rx_len` is non-zero, reads `rx_len` bytes into `rx_buf` after a
+ * repeated START. Either phase may be empty; a descriptor with both
+ * lengths zero only addresses the slave (useful to probe for ACK).
+ *
+ * The descriptor and both buffers must stay valid until `status`
+ * leaves ::I2C_PENDING.
+ */
+struct i2c_xfer {
+    uint8_t           addr7;    /**< 7-bit slave address */
+    const uint8_t    *tx_buf;   /**< Bytes to write (may be 0 if tx_len = 0) */
+    uint16_t          tx_len;   /**< Number of bytes to write */
+    uint8_t          *rx_buf;   /**< Buffer for read bytes (may be 0 if rx_len = 0) */
+    uint16_t          rx_len;   /**< Number of bytes to read */
+    i2c_done_cb_t     done;     /**< Optional completion callback (ISR context) */
+    volatile int8_t   status;   /**< I2C_PENDING, I2C_OK or I2C_ERR_x */
+};
+
+/**
+ * @brief Bus activity counters (only with I2C_STATS = 1).
+ *
+ * Used to measure the framing overhead of higher-level drivers, e.g. the
+ * number of START conditions and bytes per rendered LCD screen.
+ */
+typedef struct {
+    uint16_t starts;  /**< START and repeated START conditions */
+    uint16_t bytes;   /**< Bytes on the bus, address bytes included */
+} i2c_stats_t;
 
 /**
- * @brief Initializes the I2C peripheral in master mode (standard mode).
+ * @brief Initializes the I2C peripheral in master mode.
  *
  * This function configures the I2C peripheral timing registers according
  * to the provided CPU clock and desired I2C bus frequency.
- * The peripheral is configured for standard mode (up to 100 kHz).
+ * Frequencies up to 100 kHz use standard mode; above that the peripheral
+ * is configured for fast mode (up to 400 kHz).
  *
  * Configuration steps:
  * - Enables the I2C peripheral clock
@@ -44,15 +123,51 @@
  * - Enables ACK by default
  * - Enables the I2C peripheral
  *
- * @param[in] cpu_hz  CPU clock frequency in Hz.
+ * @param[in] cpu_hz  CPU clock frequency in Hz (clock_hz()).
  * @param[in] i2c_hz  Desired I2C bus frequency in Hz.
  *
- * @note This implementation supports only standard mode (Sm, ≤ 100 kHz).
+ * @note With CLOCK_SCALING_ENABLE the settings for the same bus speed
+ *       at every clock profile are computed as well, for i2c_set_clock().
+ * @note CCR is rounded up, so the resulting SCL frequency never exceeds
+ *       `i2c_hz`; the actual value is returned by i2c_bus_hz()
+ *       (I2C_STATS = 1).
+ * @note In fast mode the duty cycle (Tlow/Thigh = 2 or 16/9) is chosen
+ *       to get the highest SCL frequency not above `i2c_hz`.
+ * @note Fast mode needs an input clock of at least 4 MHz; below that the
+ *       bus falls back to standard mode at 100 kHz.
  * @note The CCR value is limited to the 12-bit range as required by hardware.
  */
 void i2c_master_init(uint32_t cpu_hz, uint32_t i2c_hz);
 
+#if CLOCK_SCALING_ENABLE
+/**
+ * @brief Loads the bus timing precomputed for a clock profile.
+ *
+ * i2c_master_init() computes FREQR, CCR and TRISE for the requested
+ * bus speed at every clock profile (clock.h); this only copies the
+ * values of profile @p id into the registers.
+ *
+ * @param[in] id  Clock profile, CLOCK_16MHZ ... CLOCK_2MHZ.
+ *
+ * @note Called by clock_set() after the clock switch, with the bus idle.
+ *       Does nothing before i2c_master_init().
+ */
+void i2c_set_clock(uint8_t id);
+#endif
+
 
+/**
+ * @brief Selects the fastest bus speed accepted by all attached devices.
+ *
+ * @param[in] dev_max_hz  Maximum SCL frequency of each device on the bus.
+ * @param[in] count       Number of entries in `dev_max_hz`.
+ *
+ * @return The lowest device maximum, limited to I2C_FM_MAX_HZ
+ *         (I2C_FM_MAX_HZ if `count` is 0).
+ */
+uint32_t i2c_select_speed(const uint32_t *dev_max_hz, uint8_t count);
+
+#if I2C_BYTE_API
 /**
  * @brief Generates an I2C START condition and waits for it to be sent.
  *
@@ -143,6 +258,7 @@ int  i2c_master_write_byte(uint8_t data);
  *       should be generated.
  */
 int  i2c_master_read_byte(uint8_t ack); 
+#endif
 
 /**
  * @brief Transmits a data buffer to an I2C slave device.
@@ -165,7 +281,98 @@ int  i2c_master_read_byte(uint8_t ack);
  *
  * @note The STOP condition is always generated at the end of
  *       a successful transmission.
+ * @note Blocking wrapper around i2c_submit() / i2c_wait().
  */
 int i2c_master_transmit(uint8_t addr7, const uint8_t *data, uint16_t size);
 
+/**
+ * @brief Receives a data buffer from an I2C slave device.
+ *
+ * Performs START, slave address (read mode), `size` data bytes (the
+ * last one NACKed) and STOP, blocking until the transfer is done.
+ *
+ * @param[in]  addr7  7-bit slave address.
+ * @param[out] data   Buffer for the received bytes.
+ * @param[in]  size   Number of bytes to receive.
+ *
+ * @retval  0   Reception completed successfully.
+ * @retval <0   I2C_ERR_x code (e.g. -2 if the slave NACKed its address).
+ */
+int i2c_master_receive(uint8_t addr7, uint8_t *data, uint16_t size);
+
+/**
+ * @brief Writes and then reads an I2C slave in one transaction.
+ *
+ * Sends `tx_len` bytes, generates a repeated START and reads `rx_len`
+ * bytes, blocking until the transaction is done.
+ *
+ * @param[in]  addr7   7-bit slave address.
+ * @param[in]  tx      Bytes to write.
+ * @param[in]  tx_len  Number of bytes to write.
+ * @param[out] rx      Buffer for the read bytes.
+ * @param[in]  rx_len  Number of bytes to read.
+ *
+ * @retval  0   Transaction completed successfully.
+ * @retval <0   I2C_ERR_x code.
+ */
+int i2c_master_transfer(uint8_t addr7, const uint8_t *tx, uint16_t tx_len,
+                        uint8_t *rx, uint16_t rx_len);
+
+/**
+ * @brief Queues a transaction for background execution.
+ *
+ * The descriptor is appended to the request queue and its status is set
+ * to ::I2C_PENDING. If the bus is idle the transfer starts immediately;
+ * otherwise it starts when the preceding transactions have completed.
+ * The function returns without waiting for the transfer.
+ *
+ * @param[in,out] xfer  Transaction descriptor.
+ *
+ * @retval  0             Transaction queued.
+ * @retval I2C_ERR_FULL   Request queue is full, descriptor not queued.
+ */
+int i2c_submit(i2c_xfer_t *xfer);
+
+/**
+ * @brief Waits for a queued transaction to complete.
+ *
+ * Blocks while `xfer->status` is ::I2C_PENDING. If the bus makes no
+ * progress for I2C_TIMEOUT_MAX polls, the active transaction is aborted.
+ *
+ * @param[in,out] xfer  Transaction descriptor passed to i2c_submit().
+ *
+ * @return Final transaction status (I2C_OK or I2C_ERR_x).
+ */
+int i2c_wait(i2c_xfer_t *xfer);
+
+/**
+ * @brief Checks whether the transaction engine is active.
+ *
+ * @retval 1  A transaction is in progress or waiting in the queue.
+ * @retval 0  The engine is idle.
+ */
+uint8_t i2c_busy(void);
+
+#if I2C_STATS
+/**
+ * @brief Copies the bus activity counters.
+ *
+ * @param[out] out  Destination for the counters.
+ */
+void i2c_get_stats(i2c_stats_t *out);
+
+/**
+ * @brief Resets the bus activity counters to zero.
+ */
+void i2c_reset_stats(void);
+
+/**
+ * @brief Returns the SCL frequency currently programmed.
+ *
+ * @return Actual bus frequency in Hz (after CCR rounding), 0 before
+ *         i2c_master_init().
+ */
+uint32_t i2c_bus_hz(void);
+#endif
+
 #endif /* I2C_DRIVER_H */
\ No newline at end of file
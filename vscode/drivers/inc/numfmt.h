@@ -0,0 +1,57 @@
+/**
+ * @file numfmt.h
+ * @brief Fixed-point number to ASCII conversion.
+ *
+ * Shared number formatting for the LCD and UART drivers.
+ *
+ * Values are passed as scaled integers (e.g. 2345 with 2 decimals is
+ * "23.45"), so no floating point is needed. Digits are produced by
+ * subtracting powers of ten instead of `/ 10` and `% 10`, which the
+ * STM8 has to do in software.
+ *
+ * Characters are handed to an output function one at a time as they are
+ * produced, so callers write them straight to their destination (the
+ * LCD framebuffer, the UART) without a buffer in between.
+ *
+ * @date 2026-02-04
+ */
+
+#ifndef NUMFMT_H
+#define NUMFMT_H
+
+#include <stdint.h>
+
+/* Largest supported number of decimals */
+#define FMT_MAX_DECIMALS 9
+
+/* Longest unpadded result: "-2147483648" plus a decimal point */
+#define FMT_MAX_LEN 12
+
+/* Receives one character of the result */
+typedef void (*fmt_out_t)(char c);
+
+/**
+ * @brief Formats a fixed-point number.
+ *
+ * Outputs value / 10^decimals as decimal text, right-aligned in a
+ * field of @p width characters.
+ *
+ * Examples:
+ *  - fmt_fixed(out, 2345, 2, 0, ' ')  -> "23.45"
+ *  - fmt_fixed(out, -5, 1, 0, ' ')    -> "-0.5"
+ *  - fmt_fixed(out, 42, 0, 5, ' ')    -> "   42"
+ *  - fmt_fixed(out, -42, 0, 5, '0')   -> "-0042"
+ *
+ * @param[in]  out       Called once per character, left to right.
+ * @param[in]  value     Scaled value.
+ * @param[in]  decimals  Digits after the decimal point (0 ... FMT_MAX_DECIMALS).
+ * @param[in]  width     Minimum field width, 0 for none.
+ * @param[in]  pad       Fill character; '0' pads after the sign.
+ *
+ * @retval uint8_t  Number of characters output (no terminating NUL is sent).
+ *
+ * @note The result is not truncated if it is longer than @p width.
+ */
+uint8_t fmt_fixed(fmt_out_t out, int32_t value, uint8_t decimals, uint8_t width, char pad);
+
+#endif
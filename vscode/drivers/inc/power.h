@@ -0,0 +1,138 @@
+/**
+ * @file power.h
+ * @brief Low-power idle: WFI for short gaps, active-halt with AWU for long ones.
+ *
+ * `power_idle()` is called by the main loop with the time of the next
+ * scheduled work and picks the cheapest way to wait for it:
+ *  - WFI: the CPU stops, peripherals and interrupts keep running; the
+ *    1 ms system tick wakes it at least once per millisecond;
+ *  - active-halt: the main clock stops, only the auto-wakeup (AWU)
+ *    timer runs from the 128 kHz LSI. Used for gaps of more than
+ *    POWER_HALT_MIN_MS when nothing needs the main clock.
+ *
+ * In active-halt TIM4 stops as well; on wakeup the programmed AWU time
+ * is added to millis(). The LSI is not calibrated (up to ±12.5%), so
+ * millis() may drift by that much over the halted time.
+ *
+ * Halt is not entered while an I2C transaction or a UART transmission
+ * is in progress, or while a module holds a lock (power_lock()), e.g.
+ * the MH-Z19B PWM capture, which needs TIM2 running.
+ *
+ * With POWER_STATS = 1 the time spent running, in WFI and in halt is
+ * accumulated for energy accounting (power_get_stats()).
+ *
+ * Active-halt is only built with POWER_HALT_ENABLE = 1. It is off by
+ * default because it can never be entered on this board: the TIM1
+ * encoder and the MH-Z19B PWM backends hold their locks for good, so
+ * halt could only happen with the UART backend and the buzzer instead
+ * of the encoder. The default build idles in WFI only and saves the
+ * 491 bytes of code the halt path costs (host gcc -Os: LSI/AWU setup,
+ * power_halt(), systick_advance() and the AWU handler).
+ *
+ * @date 2026-02-04
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+/* 0 = never halt, WFI only (AWU interrupt and LSI not used) */
+#ifndef POWER_HALT_ENABLE
+#define POWER_HALT_ENABLE 0
+#endif
+
+/* 1 = accumulate the time spent in each power state */
+#ifndef POWER_STATS
+#define POWER_STATS 1
+#endif
+
+/* Shortest gap worth an active-halt, ms */
+#ifndef POWER_HALT_MIN_MS
+#define POWER_HALT_MIN_MS 20u
+#endif
+
+/* Wake up this much before the deadline (LSI tolerance, wakeup time), ms */
+#define POWER_HALT_MARGIN_MS 5u
+
+/* Longest single halt, ms (AWU limit at 2^11 * 64 / 128 kHz) */
+#define POWER_HALT_MAX_MS 1024u
+
+/* Lock bits: reasons why active-halt is not allowed */
+#define POWER_LOCK_CAPTURE ((uint8_t)0x01)  /* MH-Z19B PWM capture (TIM2) */
+#define POWER_LOCK_UART    ((uint8_t)0x02)  /* UART reply expected */
+#define POWER_LOCK_ENCODER ((uint8_t)0x04)  /* TIM1 encoder must keep counting */
+
+/**
+ * @brief Time spent in each power state since power_init().
+ */
+typedef struct {
+    uint32_t run_ms;       /**< CPU running */
+    uint32_t wfi_ms;       /**< Waiting in WFI */
+    uint32_t halt_ms;      /**< In active-halt (AWU time) */
+    uint16_t halts;        /**< Number of active-halts */
+    uint16_t early_wakes;  /**< Halts ended by another interrupt (not counted in halt_ms) */
+} power_stats_t;
+
+/**
+ * @brief Prepares the AWU and clears the statistics.
+ *
+ * Starts the LSI oscillator used by the AWU.
+ *
+ * @note Call after systick_init().
+ */
+void power_init(void);
+
+/**
+ * @brief Waits for the next deadline in the cheapest power state.
+ *
+ * Returns after one WFI wakeup or one active-halt, or at once if
+ * @p until_ms has already been reached; call it in a loop.
+ *
+ * @param[in] until_ms  Time of the next work, millis() time.
+ */
+void power_idle(uint32_t until_ms);
+
+/**
+ * @brief Reports whether active-halt is allowed now.
+ *
+ * @retval 1  No lock held, I2C idle and UART transmission complete.
+ * @retval 0  Halt would disturb a running operation.
+ */
+uint8_t power_halt_allowed(void);
+
+/**
+ * @brief Forbids active-halt for a reason.
+ *
+ * @param[in] mask  POWER_LOCK_x bits.
+ *
+ * @note May be called from interrupt handlers.
+ */
+void power_lock(uint8_t mask);
+
+/**
+ * @brief Allows active-halt again for a reason.
+ *
+ * @param[in] mask  POWER_LOCK_x bits.
+ *
+ * @note May be called from interrupt handlers.
+ */
+void power_unlock(uint8_t mask);
+
+/**
+ * @brief Returns the locks currently held.
+ *
+ * @retval uint8_t  POWER_LOCK_x bits, 0 if none.
+ */
+uint8_t power_locked(void);
+
+#if POWER_STATS
+/**
+ * @brief Copies the power-state time counters.
+ *
+ * @param[out] out  Destination.
+ */
+void power_get_stats(power_stats_t *out);
+#endif
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ * @file prof.h
+ * @brief Execution-time profiling probes, compiled out by default.
+ *
+ * A probe measures the time between PROF_BEGIN(id) and PROF_END(id)
+ * with `micros()` (free-running TIM4, 4 us resolution, systick.h) and
+ * keeps per probe:
+ *  - number of runs, minimum, maximum and sum (mean = sum / runs);
+ *  - a log2 histogram: bin 0 counts runs shorter than 4 us, bin k
+ *    (k >= 1) runs of 2^(k+1) ... 2^(k+2) - 1 us, the last bin
+ *    everything longer. Bin counts saturate at 255.
+ * The spread max - min is the execution-time jitter of the probe.
+ *
+ * `prof_dump()` prints all probes over UART1, one line per probe:
+ * @code
+ * P<id>,<runs>,<min us>,<mean us>,<max us>,<bin 0> <bin 1> ... <bin 15>
+ * @endcode
+ *
+ * With PROF_ENABLE = 0 (default) the macros expand to nothing and
+ * prof.c is empty, so the probes can stay in production code.
+ *
+ * @note Times are in microseconds, not CPU cycles: the clock may be
+ *       scaled at run time (clock.h). Cycles = us * clock_hz() / 10^6.
+ * @note Each probe costs two `micros()` calls (a few microseconds at
+ *       16 MHz), included in the measured time of enclosing probes.
+ * @note A probe must be used from one context only (main loop or one
+ *       interrupt handler); probes do not nest with themselves.
+ *
+ * @date 2026-02-04
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+/* 1 = collect execution times (costs ~30 bytes of RAM per probe) */
+#ifndef PROF_ENABLE
+#define PROF_ENABLE 0
+#endif
+
+/* Probe ids */
+#define PROF_TASK0      0u   /* scheduler tasks: PROF_TASK0 + task id */
+#define PROF_TASKS      6u   /* tasks with a probe */
+#define PROF_LCD_FLOAT  6u   /* lcd_send_float() */
+#define PROF_HTU21_READ 7u   /* htu21_poll() in the sample pipeline: I2C read, CRC, conversion */
+#define PROF_CO2_ISR    8u   /* MH-Z19B capture / EXTI interrupt */
+#define PROF_PROBES     9u
+
+/* No probe: PROF_BEGIN/PROF_END do nothing */
+#define PROF_NONE       0xFFu
+
+/* Probe of scheduler task `i` (PROF_NONE past PROF_TASKS) */
+#define PROF_TASK(i)    ((uint8_t)((i) < PROF_TASKS ? PROF_TASK0 + (i) : PROF_NONE))
+
+/* Histogram bins */
+#define PROF_HIST_BINS  16u
+
+/**
+ * @brief Statistics of one probe.
+ */
+typedef struct {
+    uint32_t start;                  /**< micros() at PROF_BEGIN */
+    uint32_t sum_us;                 /**< Total time, us */
+    uint16_t runs;                   /**< Completed begin/end pairs */
+    uint16_t min_us;                 /**< Shortest run, us (valid if runs > 0) */
+    uint16_t max_us;                 /**< Longest run, us (saturates at 0xFFFF) */
+    uint8_t  hist[PROF_HIST_BINS];   /**< log2 histogram, saturating counts */
+} prof_probe_t;
+
+#if PROF_ENABLE
+
+#define PROF_BEGIN(id)  prof_begin(id)
+#define PROF_END(id)    prof_end(id)
+#define PROF_DUMP()     prof_dump()
+#define PROF_RESET()    prof_reset()
+
+/**
+ * @brief Starts a measurement.
+ *
+ * @param[in] id  Probe id, PROF_NONE or >= PROF_PROBES is ignored.
+ */
+void prof_begin(uint8_t id);
+
+/**
+ * @brief Ends a measurement and adds it to the statistics.
+ *
+ * @param[in] id  Probe id passed to prof_begin().
+ */
+void prof_end(uint8_t id);
+
+/**
+ * @brief Clears the statistics of all probes.
+ */
+void prof_reset(void);
+
+/**
+ * @brief Copies the statistics of a probe.
+ *
+ * @param[in]  id   Probe id.
+ * @param[out] out  Destination; untouched for an unknown id.
+ */
+void prof_get(uint8_t id, prof_probe_t *out);
+
+/**
+ * @brief Prints the statistics of all probes that ran over UART1.
+ *
+ * @note Blocking, about 60 characters per probe; UART1 must be
+ *       initialized and free (not used by the MH-Z19B backend), and
+ *       uart_driver.o must be in temp.lkf.
+ */
+void prof_dump(void);
+
+#else
+
+#define PROF_BEGIN(id)  ((void)0)
+#define PROF_END(id)    ((void)0)
+#define PROF_DUMP()     ((void)0)
+#define PROF_RESET()    ((void)0)
+
+#endif
+
+#endif
@@ -6,14 +6,27 @@
 #define _MEM_(mem_addr)         (*(volatile uint8_t *)(mem_addr))
 #define _SFR_(mem_addr)         (*(volatile uint8_t *)(0x5000 + (mem_addr)))
 
-#define F_CPU 16000000UL
+#define F_CPU 16000000UL /* HSI без дільника; поточна частота - clock_hz() */
 
 #define enableInterrupts()    {_asm("rim\n");}
 #define disableInterrupts()   {_asm("sim\n");}
+#define wfi()                 {_asm("wfi\n");} /* сон до наступного переривання */
+#define halt()                {_asm("halt\n");} /* зупинка тактування до EXTI/AWU */
+
+/* Save CC (interrupt mask) into `cc`, mask interrupts / restore the saved mask */
+#define ENTER_CRITICAL(cc)    {(cc) = _asm("push cc\npop a\n"); _asm("sim\n");}
+#define EXIT_CRITICAL(cc)     {_asm("push a\npop cc\n", (cc));}
+
+#define INTERRUPT @far @interrupt
+#define INTERRUPT_HANDLER(a,b) @far @interrupt void a(void)
 
 //-----------------------------Clock control (CLK)--------------------------
-#define CLK_CKDIVR  _SFR_(0xC6)
+#define CLK_CKDIVR  _SFR_(0xC6)/**< clock divider register: HSIDIV (4:3), CPUDIV (2:0) */
 #define CLK_PCKENR1 _SFR_(0x07)/**< peripheral clock enable register 1*/ 
+#define CLK_ICKR    _SFR_(0xC0)/**< internal clock control register */
+
+#define CLK_ICKR_LSIEN  ((uint8_t)0x08) /* увімкнення LSI 128 кГц */
+#define CLK_ICKR_LSIRDY ((uint8_t)0x10) /* LSI готовий */
 
 
 //______________________API___________________________________
@@ -22,6 +35,12 @@
 #define HTU21_I2C_ADDR   0x40  /* 7-bit адреса HTU21D */
 #define HTU21_READTEMP   0xE3
 #define HTU21_READHUM    0xE5
+#define HTU21_TRIGTEMP   0xF3  /* вимір температури, no-hold master */
+#define HTU21_TRIGHUM    0xF5  /* вимір вологості, no-hold master */
+#define HTU21_WRITEREG   0xE6  /* запис user register */
+#define HTU21_READREG    0xE7  /* читання user register */
+#define HTU21_REG_RES    0x81  /* біти роздільної здатності (bit7, bit0) */
+#define HTU21_I2C_MAX_HZ 400000UL /* максимальна частота SCL HTU21D */
 
 
 //-------------LCD_API(lcd_api.h)--------------------
@@ -36,6 +55,7 @@
 #define PIN_D7  (1<<7)   // P7
 
 #define LCD_ADDR 0x27
+#define LCD_I2C_MAX_HZ  100000UL /* PCF8574: лише standard mode */
 
 
 #define LCD_COLS 16
@@ -136,24 +156,45 @@ typedef struct {
 #define I2C_SR1    (*(volatile uint8_t *)(I2C_BASE + 0x07))
 #define I2C_SR2    (*(volatile uint8_t *)(I2C_BASE + 0x08))
 #define I2C_SR3    (*(volatile uint8_t *)(I2C_BASE + 0x09))
+#define I2C_ITR    (*(volatile uint8_t *)(I2C_BASE + 0x0A))
 #define I2C_CCRL   (*(volatile uint8_t *)(I2C_BASE + 0x0B))
 #define I2C_CCRH   (*(volatile uint8_t *)(I2C_BASE + 0x0C))
 #define I2C_TRISER (*(volatile uint8_t *)(I2C_BASE + 0x0D))
 
+/* Bus speed limits */
+#define I2C_SM_MAX_HZ   100000UL  /* Standard mode */
+#define I2C_FM_MAX_HZ   400000UL  /* Fast mode */
+#define I2C_FM_MIN_MHZ  4u        /* Minimum input clock for fast mode */
+
+/* CCRH bits */
+#define I2C_CCRH_FS     ((uint8_t)0x80)  /* Fast mode */
+#define I2C_CCRH_DUTY   ((uint8_t)0x40)  /* Fast mode duty: Tlow/Thigh = 16/9 */
+
 /* CR1/CR2 bits */
 #define I2C_CR1_PE      ((uint8_t)0x01)
 #define I2C_CR2_START   ((uint8_t)0x01)
-#define I2C_CR2_STOP    ((uint8_t)0x08)
-#define I2C_CR2_ACK     ((uint8_t)0x10)
+#define I2C_CR2_STOP    ((uint8_t)0x02)
+#define I2C_CR2_ACK     ((uint8_t)0x04)
+#define I2C_CR2_POS     ((uint8_t)0x08)
 
 /* SR1 bits */
 #define I2C_SR1_SB      ((uint8_t)0x01)
 #define I2C_SR1_ADDR    ((uint8_t)0x02)
+#define I2C_SR1_BTF     ((uint8_t)0x04)
 #define I2C_SR1_RXNE    ((uint8_t)0x40)
 #define I2C_SR1_TXE     ((uint8_t)0x80)
 
 /* SR2 bits */
+#define I2C_SR2_BERR    ((uint8_t)0x01)  /* Bus error */
+#define I2C_SR2_ARLO    ((uint8_t)0x02)  /* Arbitration lost */
 #define I2C_SR2_AF      ((uint8_t)0x04)  /* Acknowledge failure */
+#define I2C_SR2_OVR     ((uint8_t)0x08)  /* Overrun/underrun */
+#define I2C_SR2_ERRORS  (I2C_SR2_BERR | I2C_SR2_ARLO | I2C_SR2_AF | I2C_SR2_OVR)
+
+/* ITR bits */
+#define I2C_ITR_ITERREN ((uint8_t)0x01)  /* Error interrupt enable */
+#define I2C_ITR_ITEVTEN ((uint8_t)0x02)  /* Event interrupt enable */
+#define I2C_ITR_ITBUFEN ((uint8_t)0x04)  /* Buffer interrupt enable */
 
 /* direction for send_addr */
 #define I2C_DIR_WRITE 0
@@ -169,6 +210,12 @@ typedef struct {
 #define UART1_SR_TXE  ((uint8_t)0x80)
 #define UART1_SR_RXNE ((uint8_t)0x20)
 #define UART1_SR_BSY  ((uint8_t)0x40)
+#define UART1_SR_TC   ((uint8_t)0x40) /* передачу завершено (той самий біт, що BSY) */
+#define UART1_CR2_RIEN ((uint8_t)0x20) /* переривання RXNE / OR */
+#define UART1_SR_OR   ((uint8_t)0x08) /* переповнення приймача */
+#define UART1_SR_NF   ((uint8_t)0x04) /* шум */
+#define UART1_SR_FE   ((uint8_t)0x02) /* помилка кадру */
+#define UART1_SR_ERRORS (UART1_SR_OR | UART1_SR_NF | UART1_SR_FE)
 
 #define UART1_SR   (*(volatile unsigned char *)0x5230)
 #define UART1_DR   (*(volatile unsigned char *)0x5231)
@@ -368,4 +415,39 @@ typedef enum {
 #define PC_CR2 (*(volatile uint8_t*)0x500E)
 
 
+//-----------------------TIM4(systick.h)----------
+
+#define TIM4_CR1   (*(volatile uint8_t*)0x5340)
+#define TIM4_IER   (*(volatile uint8_t*)0x5343)
+#define TIM4_SR    (*(volatile uint8_t*)0x5344)
+#define TIM4_EGR   (*(volatile uint8_t*)0x5345)
+#define TIM4_CNTR  (*(volatile uint8_t*)0x5346)
+#define TIM4_PSCR  (*(volatile uint8_t*)0x5347)
+#define TIM4_ARR   (*(volatile uint8_t*)0x5348)
+
+#define TIM4_CR1_CEN  ((uint8_t)0x01) /* лічильник увімкнено */
+#define TIM4_CR1_URS  ((uint8_t)0x04) /* UIF лише від переповнення, не від UG */
+#define TIM4_CR1_ARPE ((uint8_t)0x80) /* буферизація ARR */
+#define TIM4_IER_UIE  ((uint8_t)0x01) /* переривання переповнення */
+#define TIM4_SR_UIF   ((uint8_t)0x01) /* прапорець переповнення */
+#define TIM4_EGR_UG   ((uint8_t)0x01) /* примусове оновлення */
+
+/* Біти I1, I0 регістра CC: обидва встановлені після sim (переривання заборонені) */
+#define CC_I_MASK     ((uint8_t)0x28)
+
+
+//-----------------------AWU(power.h)----------
+
+#define AWU_CSR    (*(volatile uint8_t*)0x50F0)
+#define AWU_APR    (*(volatile uint8_t*)0x50F1)
+#define AWU_TBR    (*(volatile uint8_t*)0x50F2)
+
+#define AWU_CSR_AWUEN ((uint8_t)0x10) /* автопробудження увімкнено */
+#define AWU_CSR_AWUF  ((uint8_t)0x20) /* прапорець пробудження (скидається читанням) */
+
+#define AWU_APR_MIN   2u   /* межі дільника APRDIV = APR + 2 */
+#define AWU_APR_MAX   64u
+#define AWU_LSI_HZ    128000UL /* номінальна частота LSI, розкид до ±12.5% */
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+/**
+ * @file systick.h
+ * @brief 1 ms system tick and monotonic time based on TIM4.
+ *
+ * TIM4 counts every 4 us (fMASTER / 64 at 16 MHz; the prescaler follows
+ * the clock profile, see clock.h) and overflows every 250 counts,
+ * i.e. every 1 ms. The update interrupt increments a
+ * 32-bit millisecond counter:
+ *  - `millis()` returns it (wraps after ~49.7 days);
+ *  - `micros()` adds the current TIM4 count, 4 us resolution
+ *    (wraps after ~71.6 minutes).
+ *
+ * Both counters wrap around; compare time stamps only with the
+ * wrap-safe helpers below, never with `<` on the raw values:
+ * @code
+ * uint32_t deadline = millis() + 500;
+ * ...
+ * if (TIME_REACHED(millis(), deadline)) { ... }
+ * @endcode
+ *
+ * @note The tick interrupt (IRQ23) must be enabled globally
+ *       (enableInterrupts()) for time to advance.
+ *
+ * @date 2026-02-04
+ */
+
+#ifndef SYSTICK_H
+#define SYSTICK_H
+
+#include <stdint.h>
+#include "clock.h"
+#include "power.h"
+
+/* Microseconds per TIM4 count */
+#define SYSTICK_US_PER_COUNT 4u
+
+/* TIM4 counts per tick */
+#define SYSTICK_COUNTS 250u
+
+/* Time `t` is at or past `deadline` (both from the same clock) */
+#define TIME_REACHED(t, deadline) ((int32_t)((uint32_t)(t) - (uint32_t)(deadline)) >= 0)
+
+/* Time elapsed from `since` to `now` (same clock, < half the wrap period) */
+#define TIME_SINCE(now, since)    ((uint32_t)((uint32_t)(now) - (uint32_t)(since)))
+
+/**
+ * @brief Starts the 1 ms tick.
+ *
+ * Configures TIM4 for a 1 ms update interrupt and clears the counters.
+ * The prescaler is taken from the current clock profile (clock_timer_psc()).
+ */
+void systick_init(void);
+
+/**
+ * @brief Reports whether the tick is running.
+ *
+ * @retval 1  systick_init() was called.
+ * @retval 0  Not started.
+ */
+uint8_t systick_running(void);
+
+/**
+ * @brief Returns milliseconds since systick_init().
+ *
+ * @retval uint32_t  Millisecond counter.
+ */
+uint32_t millis(void);
+
+/**
+ * @brief Returns microseconds since systick_init().
+ *
+ * @retval uint32_t  Microsecond counter, multiple of SYSTICK_US_PER_COUNT.
+ *
+ * @note A tick that is pending while interrupts are masked is taken
+ *       into account, so the value never goes backwards.
+ */
+uint32_t micros(void);
+
+#if CLOCK_SCALING_ENABLE
+/**
+ * @brief Changes the TIM4 prescaler after a clock switch.
+ *
+ * Loads the new prescaler at once, keeping the counter value; the
+ * current millisecond is off by less than one count (4 us).
+ *
+ * @param[in] psc  Prescaler exponent giving 4 us counts at the new fMASTER.
+ *
+ * @note Called by clock_set().
+ */
+void systick_set_prescaler(uint8_t psc);
+#endif
+
+#if POWER_HALT_ENABLE
+/**
+ * @brief Moves the millisecond counter forward.
+ *
+ * For time spent with TIM4 stopped, e.g. in active-halt (power.c).
+ *
+ * @param[in] ms  Milliseconds to add.
+ */
+void systick_advance(uint32_t ms);
+#endif
+
+/**
+ * @brief Reports whether a millisecond deadline has been reached.
+ *
+ * @param[in] deadline  Deadline in millis() time.
+ *
+ * @retval 1  millis() is at or past @p deadline.
+ * @retval 0  Not yet.
+ */
+uint8_t millis_reached(uint32_t deadline);
+
+#endif
@@ -3,13 +3,48 @@
 
 #include <stdint.h>
 
+/*
+ * 1 = build the PWM functions (buzzer, pwm.c); the encoder is always built.
+ * Off by default: on this board TIM1 counts the encoder (PC6/PC7), so the
+ * buzzer on TIM1_CH4 (PC4) is a build-time alternative to it, selected
+ * together with BUZZER_ENABLE in main.c. Building it into the encoder
+ * firmware would link about 1.4 KB of code with no caller (host gcc -Os:
+ * tim1_driver.c +1044, pwm.c +362).
+ */
+#ifndef TIM1_PWM_ENABLE
+#define TIM1_PWM_ENABLE 0
+#endif
 
+/*
+ * PWM timing for a constant frequency, computed at compile time:
+ * the counter runs at clk_hz / (PSCR + 1) and wraps every ARR + 1 counts.
+ * The divider is the smallest that fits ARR in 16 bits (finest duty
+ * resolution), ARR + 1 is the nearest whole number of counts to the
+ * exact period. For 2 <= freq_hz <= clk_hz / 2. Pass the result
+ * to TIM1_PWM_SetTiming(); `clk_hz` must be the fMASTER the timer will
+ * run at, e.g. CLOCK_PROFILE_HZ(CLOCK_16MHZ).
+ */
+#define TIM1_TICKS_FOR(clk_hz, freq_hz) (((uint32_t)(clk_hz) + (uint32_t)(freq_hz) / 2UL) / (uint32_t)(freq_hz))
+#define TIM1_PSC_FOR(clk_hz, freq_hz)   ((uint16_t)((TIM1_TICKS_FOR(clk_hz, freq_hz) + 65535UL) / 65536UL - 1UL))
+#define TIM1_DIV_HZ_FOR(clk_hz, freq_hz) ((uint32_t)(freq_hz) * (TIM1_PSC_FOR(clk_hz, freq_hz) + 1UL))
+#define TIM1_ARR_FOR(clk_hz, freq_hz) \
+    ((uint16_t)(((uint32_t)(clk_hz) + TIM1_DIV_HZ_FOR(clk_hz, freq_hz) / 2UL) / TIM1_DIV_HZ_FOR(clk_hz, freq_hz) - 1UL))
 
+#if TIM1_PWM_ENABLE
 void TIM1_InitPWM(uint8_t channel, uint16_t period, uint16_t prescaler);
 void TIM1_PWM_SetDuty(uint8_t channel, uint16_t duty);
-void TIM1_PWM_SetFrequency(uint8_t channel, uint32_t duty, uint32_t freq_hz);
+
+/* Sets the duty of `channel` as a share of the current period, 0 ... 1000 per mille */
+void TIM1_PWM_SetDutyPermille(uint8_t channel, uint16_t permille);
+
+/* Sets the PWM frequency (closed-form PSCR/ARR at clock_hz()), keeping the duty ratio of `channel` */
+void TIM1_PWM_SetFrequency(uint8_t channel, uint32_t freq_hz);
+
+/* Loads precomputed PSCR/ARR (TIM1_PSC_FOR / TIM1_ARR_FOR), keeping the duty ratio of `channel` */
+void TIM1_PWM_SetTiming(uint8_t channel, uint16_t psc, uint16_t arr);
 void TIM1_Start(void);
 void TIM1_Stop(void); 
+#endif
 void TIM1_Encoder_Init(void);
 int16_t TIM1_Encoder_Get(void);
 
@@ -2,8 +2,12 @@
 #define TIM2_DRIVER_H
 
 #include <stdint.h>
+#include "clock.h"
 
-
+/* 1 = also build TIM2_DeInit(), TIM2_GetITStatus() and TIM2_GetCapture3(); the firmware calls none of them */
+#ifndef TIM2_FULL_API
+#define TIM2_FULL_API 0
+#endif
 
 #define TIM2_PSCR  (*(volatile uint8_t*)0x530E)
 #define TIM2_ARRH  (*(volatile uint8_t*)0x530F)
@@ -51,6 +55,13 @@
 #define TIM2_CCR3L_RESET_VALUE ((uint8_t)0x00)
 
 #define TIM2_CR1_CEN     ((uint8_t)0x01)
+#define TIM2_CR1_URS     ((uint8_t)0x04) /*!< Update request source: counter overflow only. */
+#define TIM2_EGR_UG      ((uint8_t)0x01) /*!< Update generation mask. */
+#define TIM2_SR1_UIF     ((uint8_t)0x01) /*!< Update interrupt flag mask. */
+#define TIM2_SR1_CC1IF   ((uint8_t)0x02) /*!< Capture/Compare 1 interrupt flag mask. */
+#define TIM2_SR1_CC2IF   ((uint8_t)0x04) /*!< Capture/Compare 2 interrupt flag mask. */
+#define TIM2_SR2_CC1OF   ((uint8_t)0x02) /*!< Capture/Compare 1 overcapture flag mask. */
+#define TIM2_SR2_CC2OF   ((uint8_t)0x04) /*!< Capture/Compare 2 overcapture flag mask. */
 
 #define TIM2_CCER1_CC1E  ((uint8_t)0x01) /*!< Capture/Compare 1 output enable mask. */
 #define TIM2_CCER1_CC1P  ((uint8_t)0x02) /*!< Capture/Compare 1 output Polarity mask. */
@@ -138,9 +149,14 @@ typedef enum
   TIM2_IT_CC3                        = ((uint8_t)0x08)
 }TIM2_IT_TypeDef;
 
+#if TIM2_FULL_API
 void TIM2_DeInit(void);
+#endif
 void TIM2_TimeBaseInit(TIM2_Prescaler_TypeDef TIM2_Prescaler, uint16_t TIM2_Period);
 void TIM2_PrescalerConfig(TIM2_Prescaler_TypeDef Prescaler,TIM2_PSCReloadMode_TypeDef TIM2_PSCReloadMode);
+#if CLOCK_SCALING_ENABLE
+void TIM2_SwitchPrescaler(TIM2_Prescaler_TypeDef Prescaler);
+#endif
 void TIM2_Cmd(FunctionalState NewState);
 void TIM2_ICInit(TIM2_Channel_TypeDef TIM2_Channel,
                  TIM2_ICPolarity_TypeDef TIM2_ICPolarity,
@@ -148,9 +164,16 @@ void TIM2_ICInit(TIM2_Channel_TypeDef TIM2_Channel,
                  TIM2_ICPSC_TypeDef TIM2_ICPrescaler,
                  uint8_t TIM2_ICFilter);
 void TIM2_ITConfig(TIM2_IT_TypeDef TIM2_IT, FunctionalState NewState);
+#if TIM2_FULL_API
 ITStatus TIM2_GetITStatus(TIM2_IT_TypeDef TIM2_IT);
+#endif
 void TIM2_ClearITPendingBit(TIM2_IT_TypeDef TIM2_IT);
+uint16_t TIM2_GetCounter(void);
+uint16_t TIM2_GetCapture1(void);
+uint16_t TIM2_GetCapture2(void);
+#if TIM2_FULL_API
 uint16_t TIM2_GetCapture3(void);
+#endif
 void TIM2_SetIC1Prescaler(TIM2_ICPSC_TypeDef TIM2_IC1Prescaler);
 void TIM2_SetIC2Prescaler(TIM2_ICPSC_TypeDef TIM2_IC2Prescaler);
 void TIM2_SetIC3Prescaler(TIM2_ICPSC_TypeDef TIM2_IC3Prescaler);
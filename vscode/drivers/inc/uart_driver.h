@@ -9,13 +9,26 @@
  * Features:
  *  - UART1 initialization (8N1)
  *  - Blocking transmit and receive
+ *  - Optional interrupt-driven receive through a byte handler
  *  - String transmission
- *  - Integer and simple float output
+ *  - Integer, fixed-point and simple float output (numfmt.h)
+ *
+ * The float output (UART1_SendFloatSimple()) is only built with
+ * UART1_FLOAT_API=1, so that firmware without it does not pull in the
+ * floating-point routines (829 bytes of Cosmic helpers in the baseline
+ * main.elf); UART1_SendFixed() covers the same output without them.
+ * Interrupt-driven receive
+ * (UART1_SetRxHandler() and the IRQ18 handler) is only built with
+ * UART1_RX_IRQ=1.
  *
  * Intended for debugging, logging, and communication with a PC
  * terminal (e.g. via USB-UART converter).
  *
- * @note Interrupts and DMA are not used.
+ * @note Transmission is always blocking; reception uses the RX
+ *       interrupt only after UART1_SetRxHandler().
+ * @note The default firmware does not use UART1, so uart_driver.o is
+ *       not in temp.lkf; add it there for TELEMETRY_ENABLE (main.c),
+ *       MHZ19_BACKEND_UART, PROF_ENABLE or CLOCK_SCALING_ENABLE.
  * 
  * 
  * @date 2026-02-04
@@ -24,6 +37,28 @@
 #ifndef UART_DRIVER_H
 #define UART_DRIVER_H
 
+#include <stdint.h>
+#include "clock.h"
+
+/* Build UART1_SetRxHandler() and the RX interrupt handler */
+#ifndef UART1_RX_IRQ
+#define UART1_RX_IRQ 0
+#endif
+
+/* Build UART1_SendFloatSimple() */
+#ifndef UART1_FLOAT_API
+#define UART1_FLOAT_API 0
+#endif
+
+/**
+ * @brief Receive callback, called from the UART1 RX interrupt.
+ *
+ * @param[in] byte   Received byte.
+ * @param[in] error  Non-zero if the byte had a framing or noise error,
+ *                   or bytes were lost before it (overrun).
+ */
+typedef void (*uart1_rx_handler_t)(uint8_t byte, uint8_t error);
+
 
 /**
  * @brief Initializes UART1 peripheral.
@@ -36,13 +71,29 @@
  *  - No parity
  *  - 1 stop bit
  *
- * @param[in] f_cpu     CPU clock frequency in Hz.
+ * @param[in] f_cpu     CPU clock frequency in Hz (clock_hz()).
  * @param[in] baudrate  Desired UART baud rate (e.g. 9600, 115200).
  *
  * @note Baud rate divider is calculated as f_cpu / baudrate.
+ * @note With CLOCK_SCALING_ENABLE the dividers for the same baud rate
+ *       at every clock profile (clock.h) are computed as well, for
+ *       UART1_SetClock().
  */
 void UART1_Init(unsigned long f_cpu, unsigned long baudrate);
 
+#if CLOCK_SCALING_ENABLE
+/**
+ * @brief Loads the baud rate divider precomputed for a clock profile.
+ *
+ * @param[in] id  Clock profile, CLOCK_16MHZ ... CLOCK_2MHZ.
+ *
+ * @note Called by clock_set() after the clock switch, with no transfer
+ *       in progress. Does nothing before UART1_Init().
+ * @note At 4 and 2 MHz 115200 baud is about 2% fast (divider 34 / 17).
+ */
+void UART1_SetClock(uint8_t id);
+#endif
+
 /**
  * @brief Sends a single character via UART1.
  *
@@ -83,11 +134,26 @@ char UART1_ReceiveChar(void);
  */
 unsigned char UART1_DataReady(void);
 
+#if UART1_RX_IRQ
+/**
+ * @brief Installs the RX interrupt handler.
+ *
+ * With a handler installed, every received byte is passed to it from
+ * the UART1 RX interrupt (IRQ18) and UART1_ReceiveChar() /
+ * UART1_DataReady() must not be used. Passing 0 disables the interrupt.
+ *
+ * @param[in] handler  Byte handler or 0.
+ *
+ * @note Global interrupts must be enabled for the handler to run.
+ */
+void UART1_SetRxHandler(uart1_rx_handler_t handler);
+#endif
+
 /**
  * @brief Sends a signed integer value via UART1.
  *
  * Converts the integer value to its ASCII representation
- * and transmits it as a string.
+ * with `fmt_fixed()`, which transmits each character as it is produced.
  *
  * Supports negative numbers.
  *
@@ -95,6 +161,18 @@ unsigned char UART1_DataReady(void);
  */
 void UART1_SendInt(int value);
 
+/**
+ * @brief Sends a fixed-point value via UART1.
+ *
+ * Transmits value / 10^decimals, e.g. `UART1_SendFixed(-5, 2)` sends
+ * "-0.05". No floating point is used.
+ *
+ * @param[in] value     Scaled value.
+ * @param[in] decimals  Digits after the decimal point.
+ */
+void UART1_SendFixed(int32_t value, uint8_t decimals);
+
+#if UART1_FLOAT_API
 /**
  * @brief Sends a floating-point value via UART1 (simple format).
  *
@@ -105,8 +183,10 @@ void UART1_SendInt(int value);
  *
  * @param[in] val Floating-point value to send.
  *
- * @note This function does not handle rounding or scientific notation.
+ * @note The value is rounded to hundredths; scientific notation is not
+ *       supported. Prefer `UART1_SendFixed()`.
  */
 void UART1_SendFloatSimple(float val);
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "clock.h"
+#include "systick.h"
+#include "power.h"
+#include "i2c_driver.h"
+#include "uart_driver.h"
+#include "tim2_driver.h"
+#include "stm8_s.h"
+
+#if F_CPU != 16000000UL
+#error "clock: profiles assume F_CPU = 16 MHz (HSI, 4 us timer counts)"
+#endif
+
+/**
+ * @brief Settings of one clock profile.
+ */
+typedef struct {
+    uint32_t hz;         /**< fMASTER, Hz */
+    uint8_t  ckdivr;     /**< CLK_CKDIVR: HSIDIV in bits 4:3, CPUDIV = 0 */
+    uint8_t  timer_psc;  /**< TIM2/TIM4 prescaler for 4 us counts */
+} clock_profile_t;
+
+#define CLOCK_PROFILE(id) { CLOCK_PROFILE_HZ(id), (uint8_t)((id) << 3), CLOCK_TIMER_PSC(id) }
+
+/* Profile table (in flash), indexed by CLOCK_x */
+static const clock_profile_t clock_profiles[CLOCK_COUNT] = {
+    CLOCK_PROFILE(CLOCK_16MHZ),
+    CLOCK_PROFILE(CLOCK_8MHZ),
+    CLOCK_PROFILE(CLOCK_4MHZ),
+    CLOCK_PROFILE(CLOCK_2MHZ),
+};
+
+/* Current profile */
+static uint8_t clock_cur = CLOCK_16MHZ;
+
+
+#if CLOCK_SCALING_ENABLE
+/**
+ * @brief Reports whether a bus transfer would be broken by a switch.
+ *
+ * @retval 1  I2C transaction queued or running, UART transmission not
+ *            complete, or a UART reply expected.
+ * @retval 0  Buses idle.
+ */
+static uint8_t clock_bus_busy(void)
+{
+    if (i2c_busy()) return 1;
+    if ((UART1_CR2 & UART1_CR2_TEN) && !(UART1_SR & UART1_SR_TC)) return 1;
+    if (power_locked() & POWER_LOCK_UART) return 1;
+    return 0;
+}
+#endif
+
+//Selects the boot clock profile
+void clock_init(uint8_t id)
+{
+    if (id >= CLOCK_COUNT) id = CLOCK_16MHZ;
+
+    CLK_CKDIVR = clock_profiles[id].ckdivr;
+    clock_cur  = id;
+}
+
+#if CLOCK_SCALING_ENABLE
+//Switches to another clock profile and re-times the peripherals
+int8_t clock_set(uint8_t id)
+{
+    const clock_profile_t *p;
+    uint8_t cc;
+
+    if (id >= CLOCK_COUNT) return CLOCK_ERR_ARG;
+    if (id == clock_cur) return CLOCK_OK;
+
+    p = &clock_profiles[id];
+
+    ENTER_CRITICAL(cc);
+    if (clock_bus_busy())
+    {
+        EXIT_CRITICAL(cc);
+        return CLOCK_ERR_BUSY;
+    }
+
+    CLK_CKDIVR = p->ckdivr;
+    clock_cur  = id;
+
+    // timers first: they keep counting through the rest of the switch
+    systick_set_prescaler(p->timer_psc);
+    if (TIM2_CR1 & TIM2_CR1_CEN) TIM2_SwitchPrescaler((TIM2_Prescaler_TypeDef)p->timer_psc);
+
+    i2c_set_clock(id);
+    UART1_SetClock(id);
+    EXIT_CRITICAL(cc);
+
+    return CLOCK_OK;
+}
+#endif
+
+//Returns the current clock profile
+uint8_t clock_id(void)
+{
+    return clock_cur;
+}
+
+//Returns the current master clock frequency
+uint32_t clock_hz(void)
+{
+    return clock_profiles[clock_cur].hz;
+}
+
+#if CLOCK_SCALING_ENABLE
+//Returns the master clock frequency of a profile
+uint32_t clock_profile_hz(uint8_t id)
+{
+    return id < CLOCK_COUNT ? clock_profiles[id].hz : 0;
+}
+#endif
+
+//Returns the TIM2/TIM4 prescaler for the current profile
+uint8_t clock_timer_psc(void)
+{
+    return clock_profiles[clock_cur].timer_psc;
+}
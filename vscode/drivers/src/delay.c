@@ -1,16 +1,63 @@
 #include "delay.h"
+#include "systick.h"
+#include "clock.h"
 #include "stm8_s.h"
 
+/**
+ * @brief Reports whether interrupts are masked (tick cannot advance).
+ *
+ * @retval 1  Interrupts disabled.
+ * @retval 0  Interrupts enabled.
+ */
+static uint8_t delay_irq_masked(void)
+{
+    uint8_t cc;
+
+    cc = _asm("push cc\npop a\n");
+    return (uint8_t)((cc & CC_I_MASK) == CC_I_MASK);
+}
+
 //Creates a blocking delay in milliseconds
 void delay_ms(uint16_t ms)
 {
-    volatile uint32_t i;
-    for(i=0; i<((F_CPU/18000UL)*ms); i++);
+    uint32_t start;
+
+    // sleep between ticks; the CPU wakes at least every 1 ms
+    if (systick_running() && !delay_irq_masked())
+    {
+        start = micros();
+        while (TIME_SINCE(micros(), start) < (uint32_t)ms * 1000UL) wfi();
+        return;
+    }
+
+    while (ms--) DELAY_US(1000);
 }
 
 //Creates a blocking delay in microseconds
 void delay_us(uint16_t us)
 {
-    volatile uint32_t i;
-    for (i = 0; i < ((F_CPU / 18000000UL) * us); i++);
+    uint32_t start;
+
+    // long waits on the timer: exact to 4 us whatever the call overhead
+    if (us >= DELAY_US_TIMER_MIN && systick_running() && !delay_irq_masked())
+    {
+        start = micros();
+        while (TIME_SINCE(micros(), start) < us);
+        return;
+    }
+
+    // F_CPU pass counts, halved for every step of the HSI divider
+    while (us > DELAY_US_CHUNK)
+    {
+        delay_loops(DELAY_US_LOOPS(DELAY_US_CHUNK) >> clock_id());
+        us -= DELAY_US_CHUNK;
+    }
+    delay_loops(DELAY_US_LOOPS(us) >> clock_id());
+}
+
+//Busy-waits for a number of 4-cycle loop passes
+void delay_loops(uint16_t n)
+{
+    // n arrives in X; 4 cycles per pass: nop (1) + decw x (1) + jrne taken (2)
+    _asm("\ttnzw x\n\tjreq delay_end\ndelay_lp:\n\tnop\n\tdecw x\n\tjrne delay_lp\ndelay_end:\n", n);
 }
\ No newline at end of file
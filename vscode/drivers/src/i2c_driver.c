@@ -1,8 +1,52 @@
 #include "i2c_driver.h"
+#include "clock.h"
 #include "stm8_s.h"
 
 typedef unsigned long timeout_t;
 
+/* Transfer phases of the active transaction */
+#define I2C_PHASE_WRITE 0
+#define I2C_PHASE_READ  1
+
+/* Request queue (ring of descriptor pointers) */
+static i2c_xfer_t *i2c_queue[I2C_QUEUE_LEN];
+static uint8_t i2c_q_head = 0;
+static uint8_t i2c_q_tail = 0;
+static volatile uint8_t i2c_q_count = 0;
+
+/* Active transaction state, owned by the ISR while i2c_cur != 0 */
+static i2c_xfer_t * volatile i2c_cur = 0;
+static uint16_t i2c_idx;
+static uint8_t  i2c_phase;
+
+#if I2C_STATS
+static i2c_stats_t i2c_stats;
+#define I2C_STAT_INC(field) (i2c_stats.field++)
+#else
+#define I2C_STAT_INC(field)
+#endif
+
+/**
+ * @brief Bus timing registers for one input clock.
+ */
+typedef struct {
+    uint8_t freqr;  /**< Input clock, MHz */
+    uint8_t ccrl;   /**< CCR[7:0] */
+    uint8_t ccrh;   /**< F/S, DUTY and CCR[11:8] */
+    uint8_t trise;  /**< Maximum rise time in input clock periods + 1 */
+} i2c_timing_t;
+
+#if CLOCK_SCALING_ENABLE
+/* Timing of the bus speed set by i2c_master_init() for every clock profile */
+static i2c_timing_t i2c_timing[CLOCK_COUNT];
+#endif
+
+/* Set by i2c_master_init() */
+static uint8_t i2c_ready = 0;
+
+/* Incremented on every I2C interrupt, used by i2c_wait() to detect a stalled bus */
+static volatile uint8_t i2c_activity = 0;
+
 
 /**
  * @brief Clears the I2C acknowledge failure (AF) flag.
@@ -13,52 +57,144 @@ typedef unsigned long timeout_t;
  *
  * @note The AF flag is cleared by writing 0 to it.
  */
+#if I2C_BYTE_API
 static void i2c_clear_af(void) {I2C_SR2 = (uint8_t)(~I2C_SR2_AF);}
+#endif
 
-
-//Initializes the I2C peripheral in master mode (standard mode)
-void i2c_master_init(uint32_t cpu_hz, uint32_t i2c_hz)
+/**
+ * @brief Computes the bus timing registers for an input clock.
+ *
+ * @param[in]  cpu_hz  Peripheral input clock (fMASTER), Hz.
+ * @param[in]  i2c_hz  Desired SCL frequency, Hz.
+ * @param[out] t       Register values.
+ */
+static void i2c_calc_timing(uint32_t cpu_hz, uint32_t i2c_hz, i2c_timing_t *t)
 {
     unsigned long ccr;
+    unsigned long ccr_d;
     uint8_t cpu_mhz;
-    uint8_t tmp;
+    uint8_t ccrh;
 
-    CLK_PCKENR1 |= 0x01u; //Enable peripheral clock for I2C
-
-    I2C_CR1 &= (uint8_t)(~I2C_CR1_PE); //Disable peripheral while configuring
-
-    // program input clock (MHz) into FREQR 
+    // input clock (MHz) for FREQR
     cpu_mhz = (uint8_t)(cpu_hz / 1000000UL);
     if (cpu_mhz == 0) cpu_mhz = 1;
-    I2C_FREQR = cpu_mhz;
 
-    // compute CCR for standard mode: CCR = fPCLK / (2 * fSCL) 
-    ccr = (unsigned long)(cpu_hz / (2UL * i2c_hz));
-    if (ccr < 4UL) ccr = 4UL;
-    if (ccr > 0x0FFFUL) ccr = 0x0FFFUL; // 12-bit 
+    if (i2c_hz > I2C_FM_MAX_HZ) i2c_hz = I2C_FM_MAX_HZ;
+    if (i2c_hz > I2C_SM_MAX_HZ && cpu_mhz < I2C_FM_MIN_MHZ) i2c_hz = I2C_SM_MAX_HZ;
 
-    I2C_CCRL = (uint8_t)(ccr & 0xFFu);
+    if (i2c_hz > I2C_SM_MAX_HZ)
+    {
+        // fast mode: T = 3 * CCR (DUTY = 0) or 25 * CCR (DUTY = 1), rounded up
+        ccr   = (cpu_hz + 3UL * i2c_hz - 1UL) / (3UL * i2c_hz);
+        ccr_d = (cpu_hz + 25UL * i2c_hz - 1UL) / (25UL * i2c_hz);
 
-    // CCRH low nibble stores MSBs of CCR in standard mode; clear fast-mode bit 
-    tmp = (uint8_t)((ccr >> 8) & 0x0Fu);
-    I2C_CCRH = tmp; // F/S = 0 (standard mode), duty = 0 
+        // keep the duty setting that gives the faster clock
+        if (25UL * ccr_d < 3UL * ccr)
+        {
+            ccr  = ccr_d;
+            ccrh = (uint8_t)(I2C_CCRH_FS | I2C_CCRH_DUTY);
+        }
+        else
+        {
+            ccrh = I2C_CCRH_FS;
+        }
+        if (ccr > 0x0FFFUL) ccr = 0x0FFFUL; // 12-bit 
 
-    // TRISE = InputClockMHz + 1 (standard mode) 
-    I2C_TRISER = (uint8_t)(cpu_mhz + 1u);
+        // TRISE = 300 ns * fMASTER + 1 (fast mode) 
+        t->trise = (uint8_t)((cpu_mhz * 3u) / 10u + 1u);
+    }
+    else
+    {
+        // standard mode: T = 2 * CCR, rounded up 
+        ccr = (cpu_hz + 2UL * i2c_hz - 1UL) / (2UL * i2c_hz);
+        if (ccr < 4UL) ccr = 4UL;
+        if (ccr > 0x0FFFUL) ccr = 0x0FFFUL; // 12-bit 
+        ccrh = 0; // F/S = 0 (standard mode), duty = 0 
+
+        // TRISE = 1000 ns * fMASTER + 1 (standard mode) 
+        t->trise = (uint8_t)(cpu_mhz + 1u);
+    }
 
-    // enable ACK by default 
-    I2C_CR2 |= I2C_CR2_ACK;
+    t->freqr = cpu_mhz;
+    t->ccrl  = (uint8_t)(ccr & 0xFFu);
+
+    // CCRH low nibble stores MSBs of CCR, high bits select mode and duty 
+    t->ccrh  = (uint8_t)(ccrh | ((ccr >> 8) & 0x0Fu));
+}
+
+/**
+ * @brief Loads bus timing registers.
+ *
+ * CCR and TRISE may only be written with the peripheral disabled; the
+ * bus must be idle.
+ *
+ * @param[in] t  Register values.
+ */
+static void i2c_apply_timing(const i2c_timing_t *t)
+{
+    I2C_CR1 &= (uint8_t)(~I2C_CR1_PE); //Disable peripheral while configuring
+
+    I2C_FREQR  = t->freqr;
+    I2C_CCRL   = t->ccrl;
+    I2C_CCRH   = t->ccrh;
+    I2C_TRISER = t->trise;
 
-    // Enable peripheral 
+    // Enable peripheral; ACK is cleared while PE = 0
     I2C_CR1 |= I2C_CR1_PE;
+    I2C_CR2 |= I2C_CR2_ACK;
 }
 
 
+//Initializes the I2C peripheral in master mode
+void i2c_master_init(uint32_t cpu_hz, uint32_t i2c_hz)
+{
+    i2c_timing_t now;
+#if CLOCK_SCALING_ENABLE
+    uint8_t id;
+#endif
+
+    CLK_PCKENR1 |= 0x01u; //Enable peripheral clock for I2C
+
+#if CLOCK_SCALING_ENABLE
+    // settings for every clock profile, loaded by i2c_set_clock()
+    for (id = 0; id < CLOCK_COUNT; id++)
+        i2c_calc_timing(clock_profile_hz(id), i2c_hz, &i2c_timing[id]);
+#endif
+
+    i2c_calc_timing(cpu_hz, i2c_hz, &now);
+    i2c_apply_timing(&now);
+    i2c_ready = 1;
+}
+
+#if CLOCK_SCALING_ENABLE
+//Loads the bus timing precomputed for a clock profile
+void i2c_set_clock(uint8_t id)
+{
+    if (!i2c_ready || id >= CLOCK_COUNT) return;
+
+    i2c_apply_timing(&i2c_timing[id]);
+}
+#endif
+
+//Selects the fastest bus speed accepted by all attached devices
+uint32_t i2c_select_speed(const uint32_t *dev_max_hz, uint8_t count)
+{
+    uint32_t hz = I2C_FM_MAX_HZ;
+
+    while (count--)
+    {
+        if (dev_max_hz[count] < hz) hz = dev_max_hz[count];
+    }
+    return hz;
+}
+
+#if I2C_BYTE_API
 //Generates an I2C START condition and waits for it to be sent
 int i2c_master_start(void)
 {
     timeout_t t = I2C_TIMEOUT_MAX;
 
+    I2C_STAT_INC(starts);
     I2C_CR2 |= I2C_CR2_START;
     while ((I2C_SR1 & I2C_SR1_SB) == 0u)
     {
@@ -82,6 +218,7 @@ int i2c_master_send_addr(uint8_t addr7, uint8_t dir)
     volatile uint8_t tmp;
     timeout_t t = I2C_TIMEOUT_MAX;
 
+    I2C_STAT_INC(bytes);
     I2C_DR = (uint8_t)((addr7 << 1) | (dir & 1u));//write address to DR (7-bit << 1)
 
     // wait for ADDR flag 
@@ -110,6 +247,7 @@ int i2c_master_write_byte(uint8_t data)
 {
     timeout_t t = I2C_TIMEOUT_MAX;
 
+    I2C_STAT_INC(bytes);
     I2C_DR = data;
     while ((I2C_SR1 & I2C_SR1_TXE) == 0u)
     {
@@ -152,35 +290,315 @@ int i2c_master_read_byte(uint8_t ack)
         I2C_CR2 |= I2C_CR2_STOP;
     }
 
+    I2C_STAT_INC(bytes);
     data = I2C_DR;
     return (int)data;
 }
+#endif
 
 
-//Transmits a data buffer to an I2C slave device
-int i2c_master_transmit(uint8_t addr7, const uint8_t *data, uint16_t size)
+/**
+ * @brief Starts the next queued transaction, or idles the engine.
+ *
+ * Pops the oldest descriptor from the request queue, enables the event
+ * and error interrupts and generates a START condition. If the queue is
+ * empty, I2C interrupts are disabled so the polled functions can be used.
+ *
+ * @note Called with I2C interrupts masked (from the ISR or from a
+ *       critical section).
+ */
+static void i2c_start_next(void)
 {
-    int res;
-    uint16_t i;
+    i2c_xfer_t *x;
 
-    // START condition 
-    res = i2c_master_start();
-    if (res != 0) return res;
+    if (i2c_q_count == 0u)
+    {
+        i2c_cur = 0;
+        I2C_ITR = 0;
+        return;
+    }
+
+    x = i2c_queue[i2c_q_head];
+    i2c_q_head = (uint8_t)((i2c_q_head + 1u) % I2C_QUEUE_LEN);
+    i2c_q_count--;
+
+    i2c_cur   = x;
+    i2c_idx   = 0;
+    i2c_phase = (x->tx_len != 0u || x->rx_len == 0u) ? I2C_PHASE_WRITE : I2C_PHASE_READ;
+
+    I2C_CR2 |= I2C_CR2_ACK;
+    I2C_ITR  = (uint8_t)(I2C_ITR_ITEVTEN | I2C_ITR_ITERREN);
+    I2C_CR2 |= I2C_CR2_START;
+}
+
+
+/**
+ * @brief Completes the active transaction and starts the next one.
+ *
+ * @param[in] status  Final transaction status (I2C_OK or I2C_ERR_x).
+ */
+static void i2c_finish(int8_t status)
+{
+    i2c_xfer_t *x = i2c_cur;
+
+    I2C_ITR = 0;
+    x->status = status;
+    if (x->done) x->done(x);
+
+    i2c_start_next();
+}
 
-    // Send slave address (write = 0) 
-    res = i2c_master_send_addr(addr7, 0);
-    if (res != 0) return res;
 
-    // Send all bytes 
-    for (i = 0; i < size; i++)
+//I2C event/error interrupt: runs the active transaction
+INTERRUPT_HANDLER(I2C_IRQHandler, 19)
+{
+    uint8_t sr1;
+    uint8_t sr2;
+    volatile uint8_t tmp;
+    i2c_xfer_t *x = i2c_cur;
+
+    i2c_activity++;
+
+    sr2 = I2C_SR2;
+    if (sr2 & I2C_SR2_ERRORS)
     {
-        res = i2c_master_write_byte(data[i]);
-        if (res != 0) return res;  // error or NACK 
+        I2C_SR2 = 0;
+        I2C_CR2 |= I2C_CR2_STOP;
+        if (x) i2c_finish((sr2 & I2C_SR2_AF) ? I2C_ERR_NACK : I2C_ERR_BUS);
+        return;
     }
 
-    // STOP condition 
-    i2c_master_stop();
+    sr1 = I2C_SR1;
+    if (x == 0)
+    {
+        // spurious event with no active transaction
+        I2C_ITR = 0;
+        return;
+    }
+
+    // START sent: address the slave in the direction of the current phase
+    if (sr1 & I2C_SR1_SB)
+    {
+        I2C_STAT_INC(starts);
+        I2C_STAT_INC(bytes);
+        I2C_DR = (uint8_t)((x->addr7 << 1) | i2c_phase);
+        return;
+    }
+
+    // address acknowledged: ADDR is cleared by reading SR1 (done) then SR3
+    if (sr1 & I2C_SR1_ADDR)
+    {
+        if (i2c_phase == I2C_PHASE_READ && x->rx_len == 1u)
+        {
+            I2C_CR2 &= (uint8_t)(~I2C_CR2_ACK); // single byte: NACK it
+        }
+        tmp = I2C_SR3;
+        (void)tmp;
+
+        if (i2c_phase == I2C_PHASE_READ)
+        {
+            if (x->rx_len == 1u) I2C_CR2 |= I2C_CR2_STOP;
+            I2C_ITR |= I2C_ITR_ITBUFEN;
+        }
+        else if (x->tx_len == 0u)
+        {
+            // address-only probe
+            I2C_CR2 |= I2C_CR2_STOP;
+            i2c_finish(I2C_OK);
+        }
+        else
+        {
+            I2C_ITR |= I2C_ITR_ITBUFEN;
+        }
+        return;
+    }
+
+    if (i2c_phase == I2C_PHASE_READ)
+    {
+        if (sr1 & I2C_SR1_RXNE)
+        {
+            I2C_STAT_INC(bytes);
+            x->rx_buf[i2c_idx++] = I2C_DR;
+
+            if (i2c_idx + 1u == x->rx_len)
+            {
+                // next byte is the last one: NACK it and STOP afterwards
+                I2C_CR2 &= (uint8_t)(~I2C_CR2_ACK);
+                I2C_CR2 |= I2C_CR2_STOP;
+            }
+            else if (i2c_idx == x->rx_len)
+            {
+                i2c_finish(I2C_OK);
+            }
+        }
+        return;
+    }
+
+    // write phase
+    if (sr1 & I2C_SR1_TXE)
+    {
+        if (i2c_idx < x->tx_len)
+        {
+            I2C_STAT_INC(bytes);
+            I2C_DR = x->tx_buf[i2c_idx++];
+            if (i2c_idx == x->tx_len)
+            {
+                // last byte loaded: wait for BTF instead of TXE
+                I2C_ITR &= (uint8_t)(~I2C_ITR_ITBUFEN);
+            }
+        }
+        else if (sr1 & I2C_SR1_BTF)
+        {
+            if (x->rx_len != 0u)
+            {
+                // repeated START for the read phase
+                i2c_phase = I2C_PHASE_READ;
+                i2c_idx   = 0;
+                I2C_CR2  |= I2C_CR2_ACK;
+                I2C_CR2  |= I2C_CR2_START;
+            }
+            else
+            {
+                I2C_CR2 |= I2C_CR2_STOP;
+                i2c_finish(I2C_OK);
+            }
+        }
+    }
+}
+
+
+//Queues a transaction for background execution
+int i2c_submit(i2c_xfer_t *xfer)
+{
+    uint8_t cc;
+
+    if (i2c_q_count >= I2C_QUEUE_LEN) return I2C_ERR_FULL;
+
+    xfer->status = I2C_PENDING;
+
+    ENTER_CRITICAL(cc);
+    i2c_queue[i2c_q_tail] = xfer;
+    i2c_q_tail = (uint8_t)((i2c_q_tail + 1u) % I2C_QUEUE_LEN);
+    i2c_q_count++;
+    if (i2c_cur == 0) i2c_start_next();
+    EXIT_CRITICAL(cc);
+
+    return 0;
+}
+
+
+//Waits for a queued transaction to complete
+int i2c_wait(i2c_xfer_t *xfer)
+{
+    timeout_t t = I2C_TIMEOUT_MAX;
+    uint8_t seen = i2c_activity;
+    uint8_t cc;
+
+    while (xfer->status == I2C_PENDING)
+    {
+        if (seen != i2c_activity)
+        {
+            // bus is making progress: restart the timeout
+            seen = i2c_activity;
+            t = I2C_TIMEOUT_MAX;
+        }
+        else if (--t == 0u)
+        {
+            // bus stalled: abort the active transaction (ours or one queued before it)
+            ENTER_CRITICAL(cc);
+            if (i2c_cur != 0)
+            {
+                I2C_CR2 |= I2C_CR2_STOP;
+                i2c_finish(I2C_ERR_TIMEOUT);
+            }
+            EXIT_CRITICAL(cc);
+            t = I2C_TIMEOUT_MAX;
+        }
+    }
+    return xfer->status;
+}
+
+
+//Checks whether the transaction engine is active
+uint8_t i2c_busy(void)
+{
+    return (uint8_t)((i2c_cur != 0 || i2c_q_count != 0u) ? 1u : 0u);
+}
+
+
+//Writes and then reads an I2C slave in one transaction
+int i2c_master_transfer(uint8_t addr7, const uint8_t *tx, uint16_t tx_len,
+                        uint8_t *rx, uint16_t rx_len)
+{
+    i2c_xfer_t x;
+    int res;
+
+    x.addr7  = addr7;
+    x.tx_buf = tx;
+    x.tx_len = tx_len;
+    x.rx_buf = rx;
+    x.rx_len = rx_len;
+    x.done   = 0;
+
+    res = i2c_submit(&x);
+    if (res != 0) return res;
+
+    return i2c_wait(&x);
+}
+
+
+//Transmits a data buffer to an I2C slave device
+int i2c_master_transmit(uint8_t addr7, const uint8_t *data, uint16_t size)
+{
+    return i2c_master_transfer(addr7, data, size, 0, 0);
+}
+
+
+//Receives a data buffer from an I2C slave device
+int i2c_master_receive(uint8_t addr7, uint8_t *data, uint16_t size)
+{
+    return i2c_master_transfer(addr7, 0, 0, data, size);
+}
+
+
+#if I2C_STATS
+//Copies the bus activity counters
+void i2c_get_stats(i2c_stats_t *out)
+{
+    uint8_t cc;
 
-    return 0; 
+    ENTER_CRITICAL(cc);
+    *out = i2c_stats;
+    EXIT_CRITICAL(cc);
 }
 
+
+//Resets the bus activity counters to zero
+void i2c_reset_stats(void)
+{
+    uint8_t cc;
+
+    ENTER_CRITICAL(cc);
+    i2c_stats.starts = 0;
+    i2c_stats.bytes  = 0;
+    EXIT_CRITICAL(cc);
+}
+
+
+//Returns the SCL frequency currently programmed
+uint32_t i2c_bus_hz(void)
+{
+    uint16_t ccr;
+    uint8_t ccrh = I2C_CCRH;
+    uint8_t div;
+
+    if (!i2c_ready) return 0;
+
+    ccr = (uint16_t)(((uint16_t)(ccrh & 0x0Fu) << 8) | I2C_CCRL);
+    if (!(ccrh & I2C_CCRH_FS))        div = 2;
+    else if (ccrh & I2C_CCRH_DUTY)    div = 25;
+    else                              div = 3;
+
+    return (uint32_t)I2C_FREQR * 1000000UL / ((uint32_t)div * ccr);
+}
+#endif
@@ -0,0 +1,73 @@
+#include "numfmt.h"
+
+
+/* Number of decimal digits of a 32-bit magnitude */
+#define FMT_DIGITS 10
+
+/* Powers of ten for digits 0 ... FMT_DIGITS-2 (the last digit is the remainder) */
+static const uint32_t fmt_pow10[FMT_DIGITS - 1] = {
+    1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL,
+    10000UL, 1000UL, 100UL, 10UL
+};
+
+
+//Formats a fixed-point number
+uint8_t fmt_fixed(fmt_out_t out, int32_t value, uint8_t decimals, uint8_t width, char pad)
+{
+    uint32_t u;
+    uint32_t pw;
+    uint8_t first;
+    uint8_t point;
+    uint8_t len;
+    uint8_t n;
+    uint8_t i;
+    char d;
+
+    if (decimals > FMT_MAX_DECIMALS) decimals = FMT_MAX_DECIMALS;
+
+    // magnitude; also correct for the most negative value
+    u = (value < 0) ? (uint32_t)0 - (uint32_t)value : (uint32_t)value;
+
+    // leading digit: the first power of ten reached, but keep one digit before the decimal point
+    point = (uint8_t)(FMT_DIGITS - decimals);
+    first = (uint8_t)(point - 1);
+    for (i = 0; i < first; i++)
+    {
+        if (u >= fmt_pow10[i])
+        {
+            first = i;
+            break;
+        }
+    }
+
+    len = (uint8_t)(FMT_DIGITS - first + (decimals ? 1 : 0) + (value < 0 ? 1 : 0));
+    n   = (width > len) ? width : len;
+
+    // right-align: spaces before the sign, zeros after it
+    if (pad != '0')
+        for (; width > len; width--) out(pad);
+
+    if (value < 0) out('-');
+
+    if (pad == '0')
+        for (; width > len; width--) out('0');
+
+    // each digit: how many times its power of ten fits (at most 9 subtractions)
+    for (i = first; i < FMT_DIGITS - 1; i++)
+    {
+        if (i == point) out('.');
+
+        pw = fmt_pow10[i];
+        d  = '0';
+        while (u >= pw)
+        {
+            u -= pw;
+            d++;
+        }
+        out(d);
+    }
+    if (point == FMT_DIGITS - 1) out('.');
+    out((char)('0' + (uint8_t)u));
+
+    return n;
+}
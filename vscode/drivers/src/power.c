@@ -0,0 +1,223 @@
+#include "power.h"
+#include "systick.h"
+#include "i2c_driver.h"
+#include "stm8_s.h"
+
+
+/* POWER_LOCK_x bits currently held */
+static volatile uint8_t power_locks = 0;
+
+#if POWER_HALT_ENABLE
+/* Set by the AWU interrupt */
+static volatile uint8_t power_awu_fired = 0;
+#endif
+
+#if POWER_STATS
+/* millis() at power_init() */
+static uint32_t power_t0;
+
+/* Accumulated WFI and halt time: milliseconds plus a microsecond remainder */
+static uint32_t wfi_ms;
+static uint16_t wfi_us;
+static uint32_t halt_ms;
+static uint16_t halt_us;
+
+static uint16_t halts;
+static uint16_t early_wakes;
+#endif
+
+#if POWER_STATS
+/**
+ * @brief Adds a duration in microseconds to a millisecond counter.
+ *
+ * @param[in,out] ms   Milliseconds.
+ * @param[in,out] rem  Microsecond remainder (< 1000).
+ * @param[in]     us   Duration to add.
+ */
+static void power_account(uint32_t *ms, uint16_t *rem, uint32_t us)
+{
+    us += *rem;
+    while (us >= 1000UL * 1000UL)
+    {
+        *ms += 1000;
+        us  -= 1000UL * 1000UL;
+    }
+    while (us >= 1000u)
+    {
+        (*ms)++;
+        us -= 1000u;
+    }
+    *rem = (uint16_t)us;
+}
+#endif
+
+#if POWER_HALT_ENABLE
+/**
+ * @brief Sleeps in active-halt for up to @p ms milliseconds.
+ *
+ * Picks the smallest AWU timebase 2^(TBR-1) whose range covers @p ms
+ * and the largest divider APRDIV that does not exceed it:
+ * t = 2^(TBR-1) * APRDIV / 128 kHz.
+ *
+ * @param[in] ms  Requested halt time, 1 ... POWER_HALT_MAX_MS.
+ */
+static void power_halt(uint16_t ms)
+{
+    uint16_t scale = 1;     // 2^(TBR-1)
+    uint8_t  tbr   = 1;
+    uint16_t aprdiv;
+    uint32_t ticks;         // LSI periods: scale * aprdiv
+
+    ticks = (uint32_t)ms * (AWU_LSI_HZ / 1000UL);
+    while ((uint32_t)scale * AWU_APR_MAX < ticks)
+    {
+        scale <<= 1;
+        tbr++;
+    }
+    aprdiv = (uint16_t)(ticks / scale);
+    if (aprdiv < AWU_APR_MIN) aprdiv = AWU_APR_MIN;
+
+    power_awu_fired = 0;
+
+    AWU_APR = (uint8_t)(aprdiv - AWU_APR_MIN);
+    AWU_TBR = tbr;
+    AWU_CSR = AWU_CSR_AWUEN;
+
+    halt();
+
+    AWU_CSR = 0;
+    AWU_TBR = 0;    // no AWU clock while not needed
+
+#if POWER_STATS
+    halts++;
+#endif
+    if (!power_awu_fired)
+    {
+        // woken by another source: the halted time is unknown
+#if POWER_STATS
+        early_wakes++;
+#endif
+        return;
+    }
+
+    // TIM4 was stopped: credit the programmed AWU time
+    ticks = (uint32_t)scale * aprdiv * 125UL / 16UL;     // us at 128 kHz
+#if POWER_STATS
+    power_account(&halt_ms, &halt_us, ticks);
+#endif
+    systick_advance(ticks / 1000UL);
+}
+#endif
+
+//Prepares the AWU and clears the statistics
+void power_init(void)
+{
+#if POWER_HALT_ENABLE
+    CLK_ICKR |= CLK_ICKR_LSIEN;
+    while (!(CLK_ICKR & CLK_ICKR_LSIRDY));
+
+    AWU_CSR = 0;
+    AWU_TBR = 0;
+#endif
+
+#if POWER_STATS
+    power_t0    = millis();
+    wfi_ms      = 0;
+    wfi_us      = 0;
+    halt_ms     = 0;
+    halt_us     = 0;
+    halts       = 0;
+    early_wakes = 0;
+#endif
+}
+
+//Reports whether active-halt is allowed now
+uint8_t power_halt_allowed(void)
+{
+#if POWER_HALT_ENABLE
+    if (power_locks) return 0;
+    if (i2c_busy()) return 0;
+    if ((UART1_CR2 & UART1_CR2_TEN) && !(UART1_SR & UART1_SR_TC)) return 0;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+//Waits for the next deadline in the cheapest power state
+void power_idle(uint32_t until_ms)
+{
+#if POWER_HALT_ENABLE
+    uint32_t gap;
+#endif
+#if POWER_STATS
+    uint32_t t0;
+#endif
+
+    if (TIME_REACHED(millis(), until_ms)) return;
+
+#if POWER_HALT_ENABLE
+    gap = TIME_SINCE(until_ms, millis());
+    if (gap > POWER_HALT_MIN_MS && power_halt_allowed())
+    {
+        gap -= POWER_HALT_MARGIN_MS;
+        power_halt((uint16_t)(gap > POWER_HALT_MAX_MS ? POWER_HALT_MAX_MS : gap));
+        return;
+    }
+#endif
+
+#if POWER_STATS
+    t0 = micros();
+    wfi();
+    power_account(&wfi_ms, &wfi_us, TIME_SINCE(micros(), t0));
+#else
+    wfi();
+#endif
+}
+
+//Forbids active-halt for a reason
+void power_lock(uint8_t mask)
+{
+    uint8_t cc;
+
+    ENTER_CRITICAL(cc);
+    power_locks |= mask;
+    EXIT_CRITICAL(cc);
+}
+
+//Allows active-halt again for a reason
+void power_unlock(uint8_t mask)
+{
+    uint8_t cc;
+
+    ENTER_CRITICAL(cc);
+    power_locks &= (uint8_t)~mask;
+    EXIT_CRITICAL(cc);
+}
+
+//Returns the locks currently held
+uint8_t power_locked(void)
+{
+    return power_locks;
+}
+
+#if POWER_STATS
+//Copies the power-state time counters
+void power_get_stats(power_stats_t *out)
+{
+    out->wfi_ms      = wfi_ms;
+    out->halt_ms     = halt_ms;
+    out->run_ms      = TIME_SINCE(millis(), power_t0) - wfi_ms - halt_ms;
+    out->halts       = halts;
+    out->early_wakes = early_wakes;
+}
+#endif
+
+#if POWER_HALT_ENABLE
+//AWU interrupt: end of an active-halt
+INTERRUPT_HANDLER(AWU_IRQHandler, 1)
+{
+    (void)AWU_CSR;      // reading clears AWUF
+    power_awu_fired = 1;
+}
+#endif
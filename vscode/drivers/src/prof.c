@@ -0,0 +1,134 @@
+#include "prof.h"
+
+/* Empty unless profiling is enabled */
+#if PROF_ENABLE
+
+#include "systick.h"
+#include "uart_driver.h"
+#include "stm8_s.h"
+
+static prof_probe_t prof_probes[PROF_PROBES];
+
+
+/**
+ * @brief Returns the histogram bin of a duration.
+ *
+ * @param[in] us  Duration in microseconds.
+ *
+ * @retval uint8_t  0 below 4 us, else 1 + floor(log2(us / 4)),
+ *                  at most PROF_HIST_BINS - 1.
+ */
+static uint8_t prof_bin(uint32_t us)
+{
+    uint8_t bin = 0;
+
+    us >>= 2;
+    while (us && bin < PROF_HIST_BINS - 1u)
+    {
+        us >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+//Starts a measurement
+void prof_begin(uint8_t id)
+{
+    if (id >= PROF_PROBES) return;
+
+    prof_probes[id].start = micros();
+}
+
+//Ends a measurement and adds it to the statistics
+void prof_end(uint8_t id)
+{
+    prof_probe_t *p;
+    uint32_t us;
+    uint16_t us16;
+    uint8_t bin;
+
+    if (id >= PROF_PROBES) return;
+
+    p  = &prof_probes[id];
+    us = TIME_SINCE(micros(), p->start);
+    us16 = (uint16_t)(us > 0xFFFFUL ? 0xFFFFu : us);
+
+    if (p->runs == 0xFFFFu) return;     // full: keep the statistics consistent
+
+    if (!p->runs || us16 < p->min_us) p->min_us = us16;
+    if (us16 > p->max_us) p->max_us = us16;
+    p->sum_us += us;
+    p->runs++;
+
+    bin = prof_bin(us);
+    if (p->hist[bin] != 0xFFu) p->hist[bin]++;
+}
+
+//Clears the statistics of all probes
+void prof_reset(void)
+{
+    prof_probe_t *p;
+    uint8_t cc;
+    uint8_t id;
+    uint8_t i;
+
+    for (id = 0; id < PROF_PROBES; id++)
+    {
+        p = &prof_probes[id];
+
+        // probes may run in interrupt handlers
+        ENTER_CRITICAL(cc);
+        p->sum_us = 0;
+        p->runs   = 0;
+        p->min_us = 0xFFFFu;
+        p->max_us = 0;
+        for (i = 0; i < PROF_HIST_BINS; i++) p->hist[i] = 0;
+        EXIT_CRITICAL(cc);
+    }
+}
+
+//Copies the statistics of a probe
+void prof_get(uint8_t id, prof_probe_t *out)
+{
+    uint8_t cc;
+
+    if (id >= PROF_PROBES) return;
+
+    ENTER_CRITICAL(cc);
+    *out = prof_probes[id];
+    EXIT_CRITICAL(cc);
+}
+
+//Prints the statistics of all probes that ran over UART1
+void prof_dump(void)
+{
+    prof_probe_t p;
+    uint8_t id;
+    uint8_t i;
+
+    for (id = 0; id < PROF_PROBES; id++)
+    {
+        prof_get(id, &p);
+        if (!p.runs) continue;
+
+        UART1_SendChar('P');
+        UART1_SendInt(id);
+        UART1_SendChar(',');
+        UART1_SendFixed((int32_t)p.runs, 0);
+        UART1_SendChar(',');
+        UART1_SendFixed((int32_t)p.min_us, 0);
+        UART1_SendChar(',');
+        UART1_SendFixed((int32_t)(p.sum_us / p.runs), 0);
+        UART1_SendChar(',');
+        UART1_SendFixed((int32_t)p.max_us, 0);
+        UART1_SendChar(',');
+        for (i = 0; i < PROF_HIST_BINS; i++)
+        {
+            if (i) UART1_SendChar(' ');
+            UART1_SendInt(p.hist[i]);
+        }
+        UART1_SendString("\r\n");
+    }
+}
+
+#endif /* PROF_ENABLE */
@@ -17,6 +17,9 @@
  */
 
 #include "stm8_s.h"
+#include "mh-z19b.h"
+#include "power.h"
+#include "uart_driver.h"
 
 /**
  * @brief Type definition for interrupt handler function pointer.
@@ -60,12 +63,79 @@ struct interrupt_vector {
  */
 extern void _stext(void);
 
+#if POWER_HALT_ENABLE
+/**
+ * @brief Auto-wakeup interrupt handler.
+ *
+ * Ends an active-halt, implemented in the power driver (power.c).
+ */
+extern @far @interrupt void AWU_IRQHandler(void);
+#define IRQ1_HANDLER  (interrupt_handler_t)AWU_IRQHandler
+#else
+#define IRQ1_HANDLER  NonHandledInterrupt
+#endif
+
+#if MHZ19_BACKEND == MHZ19_BACKEND_EXTI
 /**
  * @brief External interrupt handler for PORTD.
  *
- * This handler must be implemented elsewhere in the project.
+ * Timestamps MH-Z19B PWM edges (mh-z19b.c, EXTI backend).
  */
 extern @far @interrupt void EXTI_PORTD_IRQHandler(void);
+#define IRQ6_HANDLER  (interrupt_handler_t)EXTI_PORTD_IRQHandler
+#else
+#define IRQ6_HANDLER  NonHandledInterrupt
+#endif
+
+#if MHZ19_BACKEND != MHZ19_BACKEND_UART
+/**
+ * @brief TIM2 update/overflow interrupt handler.
+ *
+ * Extends the MH-Z19B capture timebase (mh-z19b.c, PWM backends).
+ */
+extern @far @interrupt void TIM2_UPD_OVF_IRQHandler(void);
+#define IRQ13_HANDLER (interrupt_handler_t)TIM2_UPD_OVF_IRQHandler
+#else
+#define IRQ13_HANDLER NonHandledInterrupt
+#endif
+
+#if MHZ19_BACKEND == MHZ19_BACKEND_IC
+/**
+ * @brief TIM2 capture/compare interrupt handler.
+ *
+ * Collects MH-Z19B PWM edges latched by input capture (mh-z19b.c).
+ */
+extern @far @interrupt void TIM2_CAP_COM_IRQHandler(void);
+#define IRQ14_HANDLER (interrupt_handler_t)TIM2_CAP_COM_IRQHandler
+#else
+#define IRQ14_HANDLER NonHandledInterrupt
+#endif
+
+#if UART1_RX_IRQ
+/**
+ * @brief UART1 receive interrupt handler.
+ *
+ * Implemented in the UART driver (uart_driver.c).
+ */
+extern @far @interrupt void UART1_RX_IRQHandler(void);
+#define IRQ18_HANDLER (interrupt_handler_t)UART1_RX_IRQHandler
+#else
+#define IRQ18_HANDLER NonHandledInterrupt
+#endif
+
+/**
+ * @brief I2C event/error interrupt handler.
+ *
+ * Implemented in the I2C driver (i2c_driver.c).
+ */
+extern @far @interrupt void I2C_IRQHandler(void);
+
+/**
+ * @brief TIM4 update/overflow interrupt handler.
+ *
+ * 1 ms system tick, implemented in the systick driver (systick.c).
+ */
+extern @far @interrupt void TIM4_UPD_OVF_IRQHandler(void);
 // extern @far @interrupt void EXTI_PORTC_IRQHandler(void);
 
 /**
@@ -80,36 +150,42 @@ extern @far @interrupt void EXTI_PORTD_IRQHandler(void);
  * Interrupt mapping (STM8S series):
  *  - Vector 0: Reset
  *  - Vector 1: Trap
- *  - Vector 6: External interrupt PORTD
+ *  - Vector 1 (IRQ1): Auto-wakeup from active-halt (POWER_HALT_ENABLE)
+ *  - Vector 6: External interrupt PORTD (MH-Z19B EXTI backend)
+ *  - Vector 13: TIM2 update/overflow (MH-Z19B PWM backends)
+ *  - Vector 14: TIM2 capture/compare (MH-Z19B input capture backend)
+ *  - Vector 18: UART1 receive (UART1_RX_IRQ)
+ *  - Vector 19: I2C
+ *  - Vector 23: TIM4 update/overflow (system tick)
  *  - All other vectors use the default handler
  */
 struct interrupt_vector const _vectab[] = {
     {0x82, (interrupt_handler_t)_stext},                /**< Reset */
     {0x82, NonHandledInterrupt},                        /**< Trap */
     {0x82, NonHandledInterrupt},                        /**< IRQ0 */
-    {0x82, NonHandledInterrupt},                        /**< IRQ1 */
+    {0x82, IRQ1_HANDLER},                               /**< IRQ1  AWU */
     {0x82, NonHandledInterrupt},                        /**< IRQ2 */
     {0x82, NonHandledInterrupt},                        /**< IRQ3  PORTA */
     {0x82, NonHandledInterrupt},                        /**< IRQ4  PORTB */
     {0x82, NonHandledInterrupt},                        /**< IRQ5  PORTC */
-    {0x82, (interrupt_handler_t)EXTI_PORTD_IRQHandler}, /**< IRQ6  PORTD */
+    {0x82, IRQ6_HANDLER},                               /**< IRQ6  PORTD */
     {0x82, NonHandledInterrupt},                        /**< IRQ7  PORTE */
     {0x82, NonHandledInterrupt},                        /**< IRQ8 */
     {0x82, NonHandledInterrupt},                        /**< IRQ9 */
     {0x82, NonHandledInterrupt},                        /**< IRQ10 */
     {0x82, NonHandledInterrupt},                        /**< IRQ11 */
     {0x82, NonHandledInterrupt},                        /**< IRQ12 */
-    {0x82, NonHandledInterrupt},                        /**< IRQ13 */
-    {0x82, NonHandledInterrupt},                        /**< IRQ14 */
+    {0x82, IRQ13_HANDLER},                              /**< IRQ13 TIM2 update */
+    {0x82, IRQ14_HANDLER},                              /**< IRQ14 TIM2 capture */
     {0x82, NonHandledInterrupt},                        /**< IRQ15 */
     {0x82, NonHandledInterrupt},                        /**< IRQ16 */
     {0x82, NonHandledInterrupt},                        /**< IRQ17 */
-    {0x82, NonHandledInterrupt},                        /**< IRQ18 */
-    {0x82, NonHandledInterrupt},                        /**< IRQ19 */
+    {0x82, IRQ18_HANDLER},                              /**< IRQ18 UART1 RX */
+    {0x82, (interrupt_handler_t)I2C_IRQHandler},        /**< IRQ19 I2C */
     {0x82, NonHandledInterrupt},                        /**< IRQ20 */
     {0x82, NonHandledInterrupt},                        /**< IRQ21 */
     {0x82, NonHandledInterrupt},                        /**< IRQ22 */
-    {0x82, NonHandledInterrupt},                        /**< IRQ23 */
+    {0x82, (interrupt_handler_t)TIM4_UPD_OVF_IRQHandler}, /**< IRQ23 TIM4 update */
     {0x82, NonHandledInterrupt},                        /**< IRQ24 */
     {0x82, NonHandledInterrupt},                        /**< IRQ25 */
     {0x82, NonHandledInterrupt},                        /**< IRQ26 */
@@ -0,0 +1,112 @@
+#include "systick.h"
+#include "clock.h"
+#include "stm8_s.h"
+
+/* Milliseconds since systick_init(), incremented by the TIM4 interrupt */
+static volatile uint32_t systick_ms = 0;
+
+static uint8_t systick_on = 0;
+
+
+//Starts the 1 ms tick
+void systick_init(void)
+{
+    TIM4_CR1  = 0;
+    TIM4_PSCR = clock_timer_psc();
+    TIM4_ARR  = (uint8_t)(SYSTICK_COUNTS - 1u);
+    TIM4_CNTR = 0;
+
+    // load the prescaler now, then drop the UIF set by the forced update
+    TIM4_EGR  = TIM4_EGR_UG;
+    TIM4_SR   = 0;
+
+    systick_ms = 0;
+    systick_on = 1;
+
+    TIM4_IER = TIM4_IER_UIE;
+    TIM4_CR1 = TIM4_CR1_ARPE | TIM4_CR1_CEN;
+}
+
+//Reports whether the tick is running
+uint8_t systick_running(void)
+{
+    return systick_on;
+}
+
+//Returns milliseconds since systick_init()
+uint32_t millis(void)
+{
+    uint32_t ms;
+    uint8_t cc;
+
+    // 32-bit read is not atomic on the STM8
+    ENTER_CRITICAL(cc);
+    ms = systick_ms;
+    EXIT_CRITICAL(cc);
+
+    return ms;
+}
+
+//Returns microseconds since systick_init()
+uint32_t micros(void)
+{
+    uint32_t ms;
+    uint8_t cnt;
+    uint8_t cc;
+
+    ENTER_CRITICAL(cc);
+    ms  = systick_ms;
+    cnt = TIM4_CNTR;
+
+    // overflow not serviced yet: counted only if the count was read after it
+    if ((TIM4_SR & TIM4_SR_UIF) && cnt < SYSTICK_COUNTS / 2u)
+        ms++;
+    EXIT_CRITICAL(cc);
+
+    return ms * 1000UL + (uint16_t)cnt * SYSTICK_US_PER_COUNT;
+}
+
+#if CLOCK_SCALING_ENABLE
+//Changes the TIM4 prescaler after a clock switch
+void systick_set_prescaler(uint8_t psc)
+{
+    uint8_t cnt;
+    uint8_t cc;
+
+    ENTER_CRITICAL(cc);
+    cnt = TIM4_CNTR;
+
+    // forced update loads the prescaler now; URS keeps it from setting UIF
+    TIM4_CR1 |= TIM4_CR1_URS;
+    TIM4_PSCR = psc;
+    TIM4_EGR  = TIM4_EGR_UG;
+    TIM4_CNTR = cnt;
+    TIM4_CR1 &= (uint8_t)~TIM4_CR1_URS;
+    EXIT_CRITICAL(cc);
+}
+#endif
+
+#if POWER_HALT_ENABLE
+//Moves the millisecond counter forward
+void systick_advance(uint32_t ms)
+{
+    uint8_t cc;
+
+    ENTER_CRITICAL(cc);
+    systick_ms += ms;
+    EXIT_CRITICAL(cc);
+}
+#endif
+
+//Reports whether a millisecond deadline has been reached
+uint8_t millis_reached(uint32_t deadline)
+{
+    return (uint8_t)TIME_REACHED(millis(), deadline);
+}
+
+//TIM4 update interrupt: 1 ms tick
+INTERRUPT_HANDLER(TIM4_UPD_OVF_IRQHandler, 23)
+{
+    TIM4_SR = (uint8_t)~TIM4_SR_UIF;
+    systick_ms++;
+}
@@ -1,8 +1,10 @@
 #include "tim1_driver.h"
 #include "gpio_driver.h"
+#include "clock.h"
 #include "stm8_s.h"
 
 
+#if TIM1_PWM_ENABLE
 void TIM1_DeInit(void){
     TIM1_CR1  = TIM1_CR1_RESET_VALUE;
     TIM1_CR2  = TIM1_CR2_RESET_VALUE;
@@ -46,6 +48,7 @@ void TIM1_DeInit(void){
     TIM1_RCR   = TIM1_RCR_RESET_VALUE;
     TIM1_SR1   = TIM1_SR1_RESET_VALUE;  
 }
+
 void TIM1_InitPWM(uint8_t channel, uint16_t period, uint16_t prescaler)
 {
     TIM1_DeInit();
@@ -82,34 +85,81 @@ void TIM1_PWM_SetDuty(uint8_t channel, uint16_t duty)
     }
 }
 
-void TIM1_PWM_SetFrequency(uint8_t channel, uint32_t duty, uint32_t freq_hz)
+void TIM1_PWM_SetDutyPermille(uint8_t channel, uint16_t permille)
 {
-    uint32_t prescaler = 1;
-    uint32_t arr = (F_CPU/freq_hz)-1;
+    uint32_t period = (((uint16_t)TIM1_ARRH << 8) | TIM1_ARRL) + 1UL;
+
+    if(permille > 1000u) permille = 1000u;
 
-    while(arr > 65535 && prescaler<65536)
+    // CCR = (ARR + 1) * permille / 1000, rounded
+    TIM1_PWM_SetDuty(channel, (uint16_t)((period * permille + 500UL) / 1000UL));
+}
+
+/**
+ * @brief Returns the compare value of a PWM channel.
+ *
+ * @param[in] channel  1 ... 4.
+ *
+ * @retval uint16_t  CCRx, 0 for an unknown channel.
+ */
+static uint16_t TIM1_PWM_GetDuty(uint8_t channel)
+{
+    switch(channel)
     {
-        prescaler++;
-        arr = (F_CPU/(prescaler*freq_hz))-1;
+        case 1: return ((uint16_t)TIM1_CCR1H << 8) | TIM1_CCR1L;
+        case 2: return ((uint16_t)TIM1_CCR2H << 8) | TIM1_CCR2L;
+        case 3: return ((uint16_t)TIM1_CCR3H << 8) | TIM1_CCR3L;
+        case 4: return ((uint16_t)TIM1_CCR4H << 8) | TIM1_CCR4L;
+        default: return 0;
     }
-    if(arr>65535) arr=65535;
+}
+
+void TIM1_PWM_SetTiming(uint8_t channel, uint16_t psc, uint16_t arr)
+{
+    uint32_t old_period = (((uint16_t)TIM1_ARRH << 8) | TIM1_ARRL) + 1UL;
+    uint32_t duty = TIM1_PWM_GetDuty(channel);
 
-    TIM1_PSCRH = (uint8_t)(prescaler>>8);
-    TIM1_PSCRL = (uint8_t)(prescaler&0xFF);
+    // same share of the new period, rounded: CCR * (ARR' + 1) / (ARR + 1)
+    duty = (duty * (arr + 1UL) + old_period / 2UL) / old_period;
+
+    TIM1_PSCRH = (uint8_t)(psc>>8);
+    TIM1_PSCRL = (uint8_t)(psc&0xFF);
     TIM1_ARRH  = (uint8_t)(arr>>8);
     TIM1_ARRL  = (uint8_t)(arr&0xFF);
+    TIM1_PWM_SetDuty(channel,(uint16_t)(duty > 0xFFFFUL ? 0xFFFFUL : duty));
 
+    // load the buffered prescaler now
     TIM1_EGR |= TIM1_EGR_UG;
-    TIM1_PWM_SetDuty(channel,duty);
+}
+
+void TIM1_PWM_SetFrequency(uint8_t channel, uint32_t freq_hz)
+{
+    uint32_t cpu_hz = clock_hz();
+    uint32_t div;
+    uint32_t period;
+
+    if(freq_hz == 0) return;
+
+    // smallest divider that fits the period in 16 bits: finest duty resolution
+    div = ((cpu_hz + freq_hz/2)/freq_hz + 65535UL)/65536UL;
+    if(div == 0) div = 1;
+
+    // nearest whole number of counts to the exact period
+    period = (cpu_hz + freq_hz*div/2)/(freq_hz*div);
+    if(period < 2) period = 2;
+    if(period > 65536UL) period = 65536UL;
+
+    TIM1_PWM_SetTiming(channel, (uint16_t)(div-1), (uint16_t)(period-1));
 }
 
 void TIM1_Start(void) { TIM1_CR1 |= 0x01; }
 void TIM1_Stop(void)  { TIM1_CR1 &= ~0x01; }
+#endif
 
 
 void TIM1_Encoder_Init(void)
 {
-    TIM1_DeInit();
+    /* called once after reset: TIM1 still holds its reset values */
     CLK_PCKENR1 |= (1 << 7);
 
     /* PC6, PC7 input pull-up */
@@ -1,6 +1,7 @@
 #include "tim2_driver.h"
 #include <stdint.h>
 
+#if TIM2_FULL_API
 void TIM2_DeInit(void)
 {
 
@@ -32,6 +33,7 @@ void TIM2_DeInit(void)
     TIM2_CCR3L = (uint8_t)TIM2_CCR3L_RESET_VALUE;
     TIM2_SR1 = (uint8_t)TIM2_SR1_RESET_VALUE;
 }
+#endif
 
 
 /**
@@ -89,6 +91,31 @@ void TIM2_PrescalerConfig(TIM2_Prescaler_TypeDef Prescaler,
     TIM2_EGR = (uint8_t)TIM2_PSCReloadMode;
 }
 
+#if CLOCK_SCALING_ENABLE
+/**
+  * @brief  Changes the TIM2 Prescaler at once on a running timer.
+  * @param   Prescaler specifies the Prescaler Register value (see TIM2_PrescalerConfig()).
+  * @retval None
+  * @note   Used when fMASTER changes (clock.h): the counter value is kept
+  *         and the forced update sets no UIF, so no overflow is counted.
+  *         The prescaler counter restarts, losing less than one count.
+  *         Call with interrupts masked.
+  */
+void TIM2_SwitchPrescaler(TIM2_Prescaler_TypeDef Prescaler)
+{
+    uint16_t cnt = TIM2_GetCounter();
+
+    TIM2_CR1 |= TIM2_CR1_URS;
+    TIM2_PSCR = (uint8_t)Prescaler;
+    TIM2_EGR  = TIM2_EGR_UG;
+
+    /* UG has cleared the counter: restore it, MSB first */
+    TIM2_CNTRH = (uint8_t)(cnt >> 8);
+    TIM2_CNTRL = (uint8_t)cnt;
+    TIM2_CR1 &= (uint8_t)(~TIM2_CR1_URS);
+}
+#endif
+
 /**
   * @brief  Enables or disables the TIM2 peripheral.
   * @param   NewState new state of the TIM2 peripheral. This parameter can
@@ -291,6 +318,7 @@ void TIM2_ITConfig(TIM2_IT_TypeDef TIM2_IT, FunctionalState NewState)
 }
 
 
+#if TIM2_FULL_API
 /**
   * @brief  Checks whether the TIM2 interrupt has occurred or not.
   * @param   TIM2_IT specifies the TIM2 interrupt source to check.
@@ -322,6 +350,7 @@ ITStatus TIM2_GetITStatus(TIM2_IT_TypeDef TIM2_IT)
     }
     return (ITStatus)(bitstatus);
 }
+#endif
 
 /**
   * @brief  Clears the TIM2's interrupt pending bits.
@@ -340,6 +369,58 @@ void TIM2_ClearITPendingBit(TIM2_IT_TypeDef TIM2_IT)
     TIM2_SR1 = (uint8_t)(~TIM2_IT);
 }
 
+/**
+  * @brief  Gets the TIM2 Counter value.
+  * @param  None
+  * @retval Counter Register value.
+  * @note   CNTRH is read first: it latches CNTRL until CNTRL is read.
+  */
+uint16_t TIM2_GetCounter(void)
+{
+    uint8_t tmpcntrh;
+    uint8_t tmpcntrl;
+
+    tmpcntrh = TIM2_CNTRH;
+    tmpcntrl = TIM2_CNTRL;
+
+    return (uint16_t)(((uint16_t)tmpcntrh << 8) | tmpcntrl);
+}
+
+/**
+  * @brief  Gets the TIM2 Input Capture 1 value.
+  * @param  None
+  * @retval Capture Compare 1 Register value.
+  * @note   Reading CCR1L clears the CC1IF flag.
+  */
+uint16_t TIM2_GetCapture1(void)
+{
+    uint8_t tmpccr1h;
+    uint8_t tmpccr1l;
+
+    tmpccr1h = TIM2_CCR1H;
+    tmpccr1l = TIM2_CCR1L;
+
+    return (uint16_t)(((uint16_t)tmpccr1h << 8) | tmpccr1l);
+}
+
+/**
+  * @brief  Gets the TIM2 Input Capture 2 value.
+  * @param  None
+  * @retval Capture Compare 2 Register value.
+  * @note   Reading CCR2L clears the CC2IF flag.
+  */
+uint16_t TIM2_GetCapture2(void)
+{
+    uint8_t tmpccr2h;
+    uint8_t tmpccr2l;
+
+    tmpccr2h = TIM2_CCR2H;
+    tmpccr2l = TIM2_CCR2L;
+
+    return (uint16_t)(((uint16_t)tmpccr2h << 8) | tmpccr2l);
+}
+
+#if TIM2_FULL_API
 /**
   * @brief  Gets the TIM2 Input Capture 3 value.
   * @param  None
@@ -359,6 +440,7 @@ uint16_t TIM2_GetCapture3(void)
     /* Get the Capture 3 Register value */
     return (uint16_t)tmpccr3;
 }
+#endif
 
 /**
   * @brief  Sets the TIM2 Input Capture 1 Prescaler.
@@ -1,17 +1,45 @@
 #include "uart_driver.h"
+#include "numfmt.h"
+#include "clock.h"
 #include "stm8_s.h"
 
 
+#if UART1_RX_IRQ
+/* Byte handler for the RX interrupt, 0 = polled reception */
+static uart1_rx_handler_t uart1_rx_handler;
+#endif
+
+#if CLOCK_SCALING_ENABLE
+/* Baud rate divider of the UART1_Init() speed for every clock profile, 0 = not initialized */
+static uint16_t uart1_div[CLOCK_COUNT];
+#endif
+
+
+/**
+ * @brief Loads a baud rate divider.
+ *
+ * @param[in] uart_div  fMASTER / baud rate.
+ *
+ * @note BRR2 must be written before BRR1, which latches both.
+ */
+static void UART1_SetDivider(unsigned int uart_div)
+{
+    UART1_BRR2 = (unsigned char)(((uart_div >> 8) & 0xF0) | (uart_div & 0x0F));
+    UART1_BRR1 = (unsigned char)(uart_div >> 4);
+}
+
 //Initializes UART1 peripheral
 void UART1_Init(unsigned long f_cpu, unsigned long baudrate)
 {
-    unsigned int uart_div;
+#if CLOCK_SCALING_ENABLE
+    uint8_t id;
 
-    
-    uart_div = (unsigned int)(f_cpu / baudrate);
+    // dividers for every clock profile, loaded by UART1_SetClock()
+    for (id = 0; id < CLOCK_COUNT; id++)
+        uart1_div[id] = (uint16_t)(clock_profile_hz(id) / baudrate);
+#endif
 
-    UART1_BRR2 = (unsigned char)(((uart_div >> 8) & 0xF0) | (uart_div & 0x0F));
-    UART1_BRR1 = (unsigned char)(uart_div >> 4);
+    UART1_SetDivider((unsigned int)(f_cpu / baudrate));
 
     
     UART1_CR1 = 0x00;
@@ -21,6 +49,16 @@ void UART1_Init(unsigned long f_cpu, unsigned long baudrate)
     UART1_CR3 = 0x00;
 }
 
+#if CLOCK_SCALING_ENABLE
+//Loads the baud rate divider precomputed for a clock profile
+void UART1_SetClock(uint8_t id)
+{
+    if (id >= CLOCK_COUNT || !uart1_div[id]) return;
+
+    UART1_SetDivider(uart1_div[id]);
+}
+#endif
+
 //Sends a single character via UART1
 void UART1_SendChar(char c)
 {
@@ -51,41 +89,49 @@ unsigned char UART1_DataReady(void)
     return 0;
 }
 
-//Sends a signed integer value via UART1
-void UART1_SendInt(int value)
+#if UART1_RX_IRQ
+//Installs the RX interrupt handler
+void UART1_SetRxHandler(uart1_rx_handler_t handler)
 {
-    char buf[11]; 
-    char *p;
-    unsigned int v;
+    UART1_CR2 &= (uint8_t)~UART1_CR2_RIEN;
+    uart1_rx_handler = handler;
 
-    p = buf + sizeof(buf) - 1;
-    *p = '\0';
+    if (handler)
+    {
+        (void)UART1_SR;
+        (void)UART1_DR;     // drop a stale byte and clear error flags
+        UART1_CR2 |= UART1_CR2_RIEN;
+    }
+}
 
-    if (value < 0) v = (unsigned int)(-value);
-    else v = (unsigned int)value;
+//UART1 receive interrupt: passes the byte to the installed handler
+INTERRUPT_HANDLER(UART1_RX_IRQHandler, 18)
+{
+    uint8_t sr   = UART1_SR;
+    uint8_t byte = UART1_DR;  // SR then DR read clears RXNE and errors
 
-    do {
-        *--p = (v % 10) + '0';
-        v /= 10;
-    } while (v != 0);
+    if (uart1_rx_handler)
+        uart1_rx_handler(byte, (uint8_t)(sr & UART1_SR_ERRORS));
+}
+#endif
 
-    if (value < 0) *--p = '-';
+//Sends a signed integer value via UART1
+void UART1_SendInt(int value)
+{
+    fmt_fixed(UART1_SendChar, value, 0, 0, ' ');
+}
 
-    UART1_SendString(p);
+//Sends a fixed-point value via UART1
+void UART1_SendFixed(int32_t value, uint8_t decimals)
+{
+    fmt_fixed(UART1_SendChar, value, decimals, 0, ' ');
 }
 
+#if UART1_FLOAT_API
 //Sends a floating-point value via UART1 (simple format)
 void UART1_SendFloatSimple(float val)
 {
-    int whole;
-    int frac;
-
-    whole = (int)val;
-    frac = (int)((val - whole) * 100.0f); 
-
-    if (frac < 0) frac = -frac;
-
-    UART1_SendInt(whole);
-    UART1_SendChar('.');
-    UART1_SendInt(frac);
-}
\ No newline at end of file
+    // hundredths, rounded half away from zero
+    UART1_SendFixed((int32_t)(val * 100.0f + (val < 0 ? -0.5f : 0.5f)), 2);
+}
+#endif
@@ -1,34 +1,456 @@
 #include "stm8_s.h"
 #include "i2c_driver.h"
 #include "lcd_api.h"
-#include "delay.h"
+#include "htu21_api.h"
+#include "mh-z19b.h"
+#include "screen.h"
+#include "scheduler.h"
+#include "systick.h"
+#include "tim1_driver.h"
+#include "uart_driver.h"
+#include "pwm.h"
+#include "power.h"
+#include "clock.h"
+#include "prof.h"
 #include <stdint.h>
 
+/*
+ * TIM1 працює або як енкодер (гортання сторінок), або як ШІМ зумера:
+ * 0 - енкодер, 1 - звукова тривога CO2 замість енкодера
+ * (потрібен також TIM1_PWM_ENABLE=1 для всіх файлів).
+ */
+#ifndef BUZZER_ENABLE
+#define BUZZER_ENABLE 0
+#endif
+
+#if BUZZER_ENABLE && !TIM1_PWM_ENABLE
+#error "BUZZER_ENABLE: зумер потребує TIM1_PWM_ENABLE=1"
+#endif
+
+/*
+ * Телеметрія через UART1: 1 - рядок CSV щосекунди (додати uart_driver.o до temp.lkf;
+ * з MHZ19_BACKEND_UART порт зайнятий датчиком)
+ */
+#ifndef TELEMETRY_ENABLE
+#define TELEMETRY_ENABLE 0
+#endif
+
+#if TELEMETRY_ENABLE && MHZ19_BACKEND == MHZ19_BACKEND_UART
+#error "TELEMETRY_ENABLE: UART1 зайнятий датчиком CO2 (MHZ19_BACKEND_UART)"
+#endif
+
+#define TELEMETRY_BAUD 115200UL
+
+/* З PROF_ENABLE і TELEMETRY_ENABLE статистика профілювання виводиться з кожним N-м рядком телеметрії */
+#define PROF_DUMP_EVERY 10
+
+/*
+ * Тактова частота: повна під час роботи задач, знижена в паузах між ними
+ * (лише з CLOCK_SCALING_ENABLE=1; CLOCK_IDLE = CLOCK_16MHZ теж вимикає перемикання)
+ */
+#define CLOCK_RUN CLOCK_16MHZ
+#ifndef CLOCK_IDLE
+#define CLOCK_IDLE CLOCK_2MHZ
+#endif
+
+/* Максимальні частоти SCL пристроїв на шині i2c */
+static const uint32_t i2c_devices_hz[] = {LCD_I2C_MAX_HZ, HTU21_I2C_MAX_HZ};
+
+/* Періоди задач, мс */
+#define UI_PERIOD_MS        50
+#define HTU21_PERIOD_MS     2000  /* інтервал між вимірами */
+#define HTU21_POLL_MS       5     /* опитування під час перетворення */
+#define CO2_PERIOD_MS       1000
+#define DISPLAY_PERIOD_MS   500
+#define BUZZER_PERIOD_MS    10
+#define TELEMETRY_PERIOD_MS 1000
+
+/* Підсвітка гасне без дій користувача (і без перевищення порогу CO2), мс */
+#define BACKLIGHT_TIMEOUT_MS 30000UL
+
+/* Пороги CO2, ppm */
+#define CO2_WARN_PPM  1000
+#define CO2_ALARM_PPM 1500
+
+/* Останні виміряні значення (SCREEN_NO_VALUE - ще немає) */
+static int16_t temp_c100 = SCREEN_NO_VALUE;
+static int16_t hum_c100  = SCREEN_NO_VALUE;
+static int16_t co2_ppm   = SCREEN_NO_VALUE;
+
+/* Мінімуми та максимуми з моменту увімкнення */
+static int16_t temp_min = SCREEN_NO_VALUE;
+static int16_t temp_max = SCREEN_NO_VALUE;
+static int16_t co2_min  = SCREEN_NO_VALUE;
+static int16_t co2_max  = SCREEN_NO_VALUE;
+
+/* Номери задач у таблиці (порядок = пріоритет) */
+enum {
+    TASK_UI,
+    TASK_HTU21,
+    TASK_CO2,
+    TASK_DISPLAY,
+#if BUZZER_ENABLE
+    TASK_BUZZER,
+#endif
+#if TELEMETRY_ENABLE
+    TASK_TELEMETRY,
+#endif
+    TASK_COUNT
+};
+
+/* Джерела даних для полів екрану */
+static int16_t src_temp(void)      { return temp_c100; }
+static int16_t src_hum(void)       { return hum_c100; }
+static int16_t src_co2(void)       { return co2_ppm; }
+static int16_t src_temp_min(void)  { return temp_min; }
+static int16_t src_temp_max(void)  { return temp_max; }
+static int16_t src_co2_min(void)   { return co2_min; }
+static int16_t src_co2_max(void)   { return co2_max; }
+static int16_t src_co2_warn(void)  { return CO2_WARN_PPM; }
+static int16_t src_co2_alarm(void) { return CO2_ALARM_PPM; }
+
+/* Діагностика: пропущені дедлайни задачі (до 99 на поле) */
+static int16_t overruns(uint8_t id)
+{
+    uint16_t n = sched_overruns(id);
+
+    return (int16_t)(n > 99 ? 99 : n);
+}
+
+static int16_t src_ovr_ui(void)      { return overruns(TASK_UI); }
+static int16_t src_ovr_htu21(void)   { return overruns(TASK_HTU21); }
+static int16_t src_ovr_co2(void)     { return overruns(TASK_CO2); }
+static int16_t src_ovr_display(void) { return overruns(TASK_DISPLAY); }
+
+#if HTU21_STATS
+/* Помилки HTU21: CRC, I2C і тайм-аути перетворення */
+static int16_t src_htu21_err(void)
+{
+    htu21_errors_t e;
+    uint16_t n;
+
+    htu21_get_errors(&e);
+    n = (uint16_t)(e.crc + e.i2c + e.timeout);
+    return (int16_t)(n > 9999 ? 9999 : n);
+}
+#endif
+
+#if POWER_STATS
+/* Частка часу у WFI та halt з моменту увімкнення, 0.1 % */
+static int16_t src_sleep(void)
+{
+    power_stats_t ps;
+    uint32_t idle;
+    uint32_t div;
+
+    power_get_stats(&ps);
+    idle = ps.wfi_ms + ps.halt_ms;
+    div  = (ps.run_ms + idle) / 1000u;   // мс на 0.1 %
+    if (div == 0) return SCREEN_NO_VALUE;
+    idle /= div;
+    return (int16_t)(idle > 1000 ? 1000 : idle);
+}
+#endif
+
+/* Сторінки екрану (зберігаються у flash) */
+static const screen_field_t page_now[] = {
+    // row col label   width dec step source
+    {  0,  0, "T",       5,   1,  10, src_temp  },  // "T 23.4C"
+    {  0,  6, "C",       0,   0,   0, 0         },
+    {  0,  9, "RH",      3,   0, 100, src_hum   },  // "RH 45%"
+    {  0, 14, "%",       0,   0,   0, 0         },
+    {  1,  0, "CO2",     5,   0,   1, src_co2   },  // "CO2  812 ppm"
+    {  1,  9, "ppm",     0,   0,   0, 0         },
+};
+
+static const screen_field_t page_minmax[] = {
+    {  0,  0, "T",       5,   1,  10, src_temp_min },  // "T 21.0  25.3"
+    {  0,  6, " ",       5,   1,  10, src_temp_max },
+    {  1,  0, "CO2",     5,   0,   1, src_co2_min  },  // "CO2  412 1530"
+    {  1,  8, "",        5,   0,   1, src_co2_max  },
+};
+
+static const screen_field_t page_limits[] = {
+    {  0,  0, "CO2 warn",  5, 0,   1, src_co2_warn  },
+    {  1,  0, "CO2 alarm", 5, 0,   1, src_co2_alarm },
+};
+
+/* Пропущені дедлайни задач UI, HTU21, CO2, дисплею; помилки HTU21 */
+static const screen_field_t page_diag[] = {
+    {  0,  0, "Overruns", 0,  0,   0, 0               },  // "Overruns Err   0"
+#if HTU21_STATS
+    {  0,  9, "Err",       4,  0,   1, src_htu21_err   },
+#endif
+    {  1,  0, "U",         2,  0,   1, src_ovr_ui      },  // "U 0 H 0 C 0 D 0"
+    {  1,  4, "H",         2,  0,   1, src_ovr_htu21   },
+    {  1,  8, "C",         2,  0,   1, src_ovr_co2     },
+    {  1, 12, "D",         2,  0,   1, src_ovr_display },
+};
+
+#if POWER_STATS
+static const screen_field_t page_power[] = {
+    {  0,  0, "Sleep",     5,  1,   1, src_sleep       },  // "Sleep  97.3%"
+    {  0, 11, "%",         0,  0,   0, 0               },
+};
+#endif
+
+#define PAGE(fields) { fields, sizeof(fields) / sizeof(fields[0]) }
+
+static const screen_page_t pages[] = {
+    PAGE(page_now),
+    PAGE(page_minmax),
+    PAGE(page_limits),
+    PAGE(page_diag),
+#if POWER_STATS
+    PAGE(page_power),
+#endif
+};
+
+#define PAGE_COUNT (sizeof(pages) / sizeof(pages[0]))
+
+/* Оновлення мінімуму та максимуму новим значенням */
+static void track_minmax(int16_t value, int16_t *min, int16_t *max)
+{
+    if (value == SCREEN_NO_VALUE) return;
+    if (*min == SCREEN_NO_VALUE || value < *min) *min = value;
+    if (*max == SCREEN_NO_VALUE || value > *max) *max = value;
+}
+
+static uint8_t page = 0;  // поточна сторінка
+
+static uint32_t last_activity = 0;  // millis() останньої дії користувача
+static uint8_t  backlight     = 1;  // стан підсвітки
+
+/*
+ * Підсвітка: вмикається дією користувача або CO2 від порогу
+ * попередження, гасне через BACKLIGHT_TIMEOUT_MS.
+ * Повертає 1, якщо дія лише розбудила дисплей.
+ */
+static uint8_t backlight_update(uint8_t activity)
+{
+    uint32_t now = millis();
+    uint8_t woke = 0;
+
+    if (co2_ppm != SCREEN_NO_VALUE && co2_ppm >= CO2_WARN_PPM) activity = 1;
+
+    if (activity)
+    {
+        last_activity = now;
+        woke = (uint8_t)!backlight;
+        backlight = 1;
+    }
+    else if (backlight && TIME_SINCE(now, last_activity) >= BACKLIGHT_TIMEOUT_MS)
+    {
+        backlight = 0;
+    }
+
+    lcd_backlight(backlight);
+    return woke;
+}
+
+#if !BUZZER_ENABLE
+/* Енкодер гортає сторінки; перший поворот при згаслій підсвітці лише вмикає її */
+static void task_ui(void)
+{
+    static int16_t last_value = 0;  // попереднє значення енкодера
+    int16_t encoder_value = TIM1_Encoder_Get();
+    int16_t delta = encoder_value - last_value;
+
+    last_value = encoder_value;
+    if (backlight_update(delta != 0) || !delta) return;
+
+    if (delta > 0) page = (uint8_t)((page + 1) % PAGE_COUNT);
+    else           page = (uint8_t)((page + PAGE_COUNT - 1) % PAGE_COUNT);
+    screen_show(&pages[page]);
+}
+#else
+/* Без енкодера сторінки перемикаються самі */
+static void task_ui(void)
+{
+    static uint8_t ticks = 0;
+
+    backlight_update(0);
+
+    if (++ticks < 100) return;  // 5 с
+    ticks = 0;
+    page = (uint8_t)((page + 1) % PAGE_COUNT);
+    screen_show(&pages[page]);
+}
+#endif
+
+/* HTU21 без блокування: під час перетворення задача просить частіший запуск */
+static void task_htu21(void)
+{
+    htu21_sample_t sample;
+    int rc = htu21_sample_step(&sample);
+
+    if (rc == HTU21_BUSY)
+    {
+        sched_wake_in(TASK_HTU21, HTU21_POLL_MS);
+        return;
+    }
+
+    if (rc == 0)
+    {
+        temp_c100 = sample.temp_c100;
+        hum_c100  = sample.hum_comp_c100;
+        track_minmax(temp_c100, &temp_min, &temp_max);
+    }
+}
+
+static void task_co2(void)
+{
+    uint16_t ppm = MHZ19_GetPPM();
+
+    if (!ppm) return;
+
+    co2_ppm = (int16_t)ppm;
+    track_minmax(co2_ppm, &co2_min, &co2_max);
+}
+
+static void task_display(void)
+{
+    screen_update(); // перемальовуються лише змінені поля
+    lcd_flush(); // на дисплей йдуть лише змінені символи
+}
+
+#if BUZZER_ENABLE
+/* Тривога CO2 активна (зумер працює) */
+static uint8_t alarm = 0;
+
+/* Тривога CO2 з гістерезисом: вмикається на порозі тривоги, вимикається нижче попередження */
+static void task_buzzer(void)
+{
+    if (!alarm && co2_ppm != SCREEN_NO_VALUE && co2_ppm >= CO2_ALARM_PPM)
+    {
+        alarm = 1;
+        Buzzer_Start(2000, 500, 200, 800); // 2 кГц, 50 %, 200 мс звук / 800 мс пауза
+    }
+    else if (alarm && co2_ppm < CO2_WARN_PPM)
+    {
+        alarm = 0;
+        Buzzer_Stop();
+    }
+
+    if (alarm) Buzzer_Update();
+}
+#endif
+
+#if CLOCK_SCALING_ENABLE
+/* Частота для паузи; частота ШІМ зумера (TIM1) залежить від fMASTER, тож під час тривоги - повна */
+static uint8_t idle_clock(void)
+{
+#if BUZZER_ENABLE
+    if (alarm) return CLOCK_RUN;
+#endif
+    return CLOCK_IDLE;
+}
+#endif
+
+#if TELEMETRY_ENABLE
+/* Значення поля CSV; порожнє, якщо даних ще немає */
+static void send_field(int16_t value, uint8_t decimals)
+{
+    if (value != SCREEN_NO_VALUE) UART1_SendFixed(value, decimals);
+}
+
+/*
+ * Рядок CSV: температура (°C), вологість (%), CO2 (ppm),
+ * з POWER_STATS - ще час роботи, WFI та halt (с)
+ */
+static void task_telemetry(void)
+{
+#if POWER_STATS
+    power_stats_t ps;
+#endif
+#if PROF_ENABLE
+    static uint8_t lines = 0;
+#endif
+
+    send_field(temp_c100, 2);
+    UART1_SendChar(',');
+    send_field(hum_c100, 2);
+    UART1_SendChar(',');
+    send_field(co2_ppm, 0);
+#if POWER_STATS
+    power_get_stats(&ps);
+    UART1_SendChar(',');
+    UART1_SendFixed((int32_t)ps.run_ms, 3);
+    UART1_SendChar(',');
+    UART1_SendFixed((int32_t)ps.wfi_ms, 3);
+    UART1_SendChar(',');
+    UART1_SendFixed((int32_t)ps.halt_ms, 3);
+#endif
+    UART1_SendString("\r\n");
+
+#if PROF_ENABLE
+    // рядки "P<id>,..." (prof.h); час виводу входить у максимум цієї задачі
+    if (++lines >= PROF_DUMP_EVERY)
+    {
+        lines = 0;
+        PROF_DUMP();
+    }
+#endif
+}
+#endif
+
+/* Таблиця задач (у flash) */
+static const sched_task_t tasks[TASK_COUNT] = {
+    { task_ui,        UI_PERIOD_MS        },
+    { task_htu21,     HTU21_PERIOD_MS     },
+    { task_co2,       CO2_PERIOD_MS       },
+    { task_display,   DISPLAY_PERIOD_MS   },
+#if BUZZER_ENABLE
+    { task_buzzer,    BUZZER_PERIOD_MS    },
+#endif
+#if TELEMETRY_ENABLE
+    { task_telemetry, TELEMETRY_PERIOD_MS },
+#endif
+};
+
+static sched_state_t task_state[TASK_COUNT];
+
 int main(void)
 {
-    int16_t encoder_value = 0;    // поточне значення енкодера
-    int16_t last_value    = 0;    // попереднє значення
-    int16_t delta         = 0;    // різниця для обробки
-    
-    CLK_CKDIVR = 0x00;//16Mhz
+    clock_init(CLOCK_RUN); // 16 МГц, далі драйвери налаштовуються від clock_hz()
 
+#if BUZZER_ENABLE
+    Buzzer_Init(4, 1000, 3); // ШІМ зумера на TIM1_CH4
+#else
     TIM1_Encoder_Init(); // ініціалізація таймера-енкодера
+    power_lock(POWER_LOCK_ENCODER); // у halt енкодер не рахує
+#endif
 
-    i2c_master_init(F_CPU, 10000UL); // ініціалізація i2c 
+    i2c_master_init(clock_hz(), i2c_select_speed(i2c_devices_hz, 2)); // ініціалізація i2c на максимальній спільній частоті
+    MHZ19_Init(); // датчик CO2
+#if TELEMETRY_ENABLE
+    UART1_Init(clock_hz(), TELEMETRY_BAUD);
+#endif
+    systick_init(); // системний таймер 1 мс (TIM4)
+    power_init(); // AWU для active-halt
+    enableInterrupts(); // i2c і systick працюють через переривання
     lcd_init(); // ініціалізація дисплею
 
+    screen_show(&pages[page]);
+    sched_init(tasks, task_state, TASK_COUNT);
+    last_activity = millis();
 
     while(1)
     {
-        encoder_value = TIM1_Encoder_Get();      // зчитування значення
-
-        delta = encoder_value - last_value;     // обчислюємо різницю
-        last_value = encoder_value;
-
-        lcd_clear();
-        lcd_put_cur(0,0);
-        lcd_send_int(encoder_value);
-        
-        delay_ms(500);
+        if (TIME_REACHED(millis(), sched_next_release()))
+        {
+#if CLOCK_SCALING_ENABLE
+            clock_set(CLOCK_RUN); // зайнята шина - задачі виконаються на поточній частоті
+#endif
+            sched_run();
+        }
+#if MHZ19_BACKEND == MHZ19_BACKEND_UART
+        MHZ19_Poll(); // датчик мовчить понад 100 мс - звільнити UART для сну
+#endif
+        // пауза: знижена частота (коли шини вільні), далі WFI або active-halt
+#if CLOCK_SCALING_ENABLE
+        clock_set(idle_clock());
+#endif
+        power_idle(sched_next_release());
     }
 }
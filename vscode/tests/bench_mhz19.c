@@ -0,0 +1,60 @@
+/*
+ * MH-Z19B ppm calculation: host timing of mhz19_cycle_ppm() on the
+ * multiply-and-shift path (period within 2 % of nominal) and on the
+ * exact 32-bit divide (period further off).
+ *
+ * The static function is reached by compiling mh-z19b.c into this file.
+ * The times are host nanoseconds: a host CPU divides in hardware, so the
+ * ratio understates the gain on the STM8, where Cosmic calls a library
+ * routine for the 32-bit divide. Accuracy is checked by test_mhz19_raw.
+ */
+#include <time.h>
+#include "../api/src/mh-z19b.c"
+
+/* ================= STUBS ================= */
+void power_lock(uint8_t mask) { (void)mask; }
+uint8_t clock_timer_psc(void) { return 6; }
+
+/* ================= BENCHMARK ================= */
+#define CALLS 20000000UL
+
+static volatile uint32_t sink;
+
+static double ns_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Average ns per call over high times spread across 0-5000 ppm */
+static double bench(uint32_t period)
+{
+    static uint32_t high[1024];
+    volatile uint32_t T = period;
+    uint32_t sum = 0;
+    unsigned long i;
+    double t0;
+
+    for (i = 0; i < 1024; i++)
+        high[i] = MHZ19_T2MS + (uint32_t)(i * 7919UL % (period - MHZ19_T4MS));
+
+    t0 = ns_now();
+    for (i = 0; i < CALLS; i++)
+        sum += mhz19_cycle_ppm(high[i & 1023u], T);
+    sink = sum;
+
+    return (ns_now() - t0) / CALLS;
+}
+
+int main(void)
+{
+    double fast  = bench(MHZ19_PERIOD_NOM + 1000u);
+    double exact = bench(MHZ19_PERIOD_NOM + 10000u);
+
+    printf("  mhz19_cycle_ppm(), host: fast path %.2f ns/call, "
+           "exact divide %.2f ns/call\n", fast, exact);
+
+    return 0;
+}
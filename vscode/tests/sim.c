@@ -0,0 +1,25 @@
+#include <string.h>
+#include "sim.h"
+
+
+uint8_t sim_mem[0x10000];
+
+void (*sim_on_access)(uint16_t addr) = 0;
+
+int sim_failures = 0;
+
+
+//Returns the simulated byte behind a register address
+volatile uint8_t *sim_reg(uint16_t addr)
+{
+    if (sim_on_access) sim_on_access(addr);
+
+    return &sim_mem[addr];
+}
+
+//Clears all registers and removes the access hook
+void sim_reset(void)
+{
+    memset(sim_mem, 0, sizeof(sim_mem));
+    sim_on_access = 0;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file sim.h
+ * @brief Simulated STM8 register file for the host tests.
+ *
+ * The Makefile copies the firmware headers to build/inc and routes every
+ * register address through SIM_ADDR(), so `I2C_SR1`, `TIM2_CNTRL`,
+ * `GPIOD->IDR` etc. become bytes of `sim_mem[]`. A test can observe
+ * the accesses with `sim_on_access` (called before the read or write
+ * happens) to model peripherals whose flags react to register reads,
+ * e.g. ADDR cleared by reading SR3.
+ *
+ * The Cosmic inline assembly (_asm) evaluates to 0; ENTER_CRITICAL()
+ * and EXIT_CRITICAL() therefore do nothing, which is what a
+ * single-threaded host test needs.
+ *
+ * @date 2026-02-05
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Whole 64 KB STM8 address space (registers, RAM, EEPROM, option bytes) */
+extern uint8_t sim_mem[0x10000];
+
+/* Called on every register access with the register address, or 0 */
+extern void (*sim_on_access)(uint16_t addr);
+
+/**
+ * @brief Returns the simulated byte behind a register address.
+ *
+ * @param[in] addr  STM8 address.
+ *
+ * @retval volatile uint8_t*  Pointer into sim_mem[].
+ */
+volatile uint8_t *sim_reg(uint16_t addr);
+
+/**
+ * @brief Clears all registers and removes the access hook.
+ */
+void sim_reset(void);
+
+#define SIM_ADDR(addr) sim_reg((uint16_t)(addr))
+
+/* Cosmic inline assembly */
+#define _asm(...) 0
+
+/* Test assertion: prints the failed condition and counts it */
+extern int sim_failures;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { sim_failures++; \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } } while (0)
+
+#endif
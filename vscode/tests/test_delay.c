@@ -0,0 +1,44 @@
+/*
+ * Cycle-counted delays: DELAY_US_LOOPS() against the cycle model of
+ * delay.h (4 cycles per pass plus DELAY_CALL_CYCLES per call).
+ *
+ * This checks the compile-time arithmetic only. The model itself comes
+ * from the PM0044 instruction table and is not measured here.
+ */
+#include <stdlib.h>
+#include "delay.h"
+
+static void test_loops(void)
+{
+    unsigned long us;
+    unsigned long want;
+    unsigned long got;
+    long err;
+    long worst = 0;
+
+    for (us = 1; us <= DELAY_US_CHUNK; us++)
+    {
+        want = us * DELAY_CYCLES_PER_US;
+        got  = 4UL * DELAY_US_LOOPS(us) + DELAY_CALL_CYCLES;
+        err  = (long)got - (long)want;
+
+        // the shortest waits are clamped to one pass
+        if (want <= DELAY_CALL_CYCLES + 4UL)
+            CHECK(DELAY_US_LOOPS(us) == 1);
+        else if (labs(err) > worst)
+            worst = labs(err);
+    }
+
+    printf("  DELAY_US(1..%u) at %lu MHz: within %ld cycles of the model\n",
+           DELAY_US_CHUNK, DELAY_CYCLES_PER_US, worst);
+    CHECK(worst <= 2);
+    CHECK((unsigned long)DELAY_US_LOOPS(DELAY_US_CHUNK) <= 0xFFFFUL);
+}
+
+int main(void)
+{
+    test_loops();
+
+    printf("%s\n", sim_failures ? "FAILED" : "OK");
+    return sim_failures != 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * HTU21D driver: fixed-point conversions against the datasheet formulas,
+ * CRC check, retries and error counters.
+ *
+ * The I2C functions are replaced by a scripted sensor: each read returns
+ * the next queued reply (a frame, a NACK while converting, or a bus
+ * error). Delay and systick are stubs.
+ */
+#include <math.h>
+#include <string.h>
+#include "htu21_api.h"
+#include "i2c_driver.h"
+#include "delay.h"
+#include "systick.h"
+
+/* ================= SENSOR ================= */
+#define REPLY_FRAME 0
+#define REPLY_NACK  1
+#define REPLY_ERR   2
+
+static struct {
+    uint8_t kind;
+    uint8_t frame[3];
+} replies[8];
+static uint8_t reply_head, reply_tail;
+static unsigned triggers;
+static uint8_t user_reg = 0x02;   /* power-on value: RH12/T14, OTP reload off */
+
+static void reply(uint8_t kind, uint8_t msb, uint8_t lsb, uint8_t crc)
+{
+    replies[reply_tail].kind     = kind;
+    replies[reply_tail].frame[0] = msb;
+    replies[reply_tail].frame[1] = lsb;
+    replies[reply_tail].frame[2] = crc;
+    reply_tail = (uint8_t)((reply_tail + 1u) & 7u);
+}
+
+/* ================= STUBS ================= */
+int i2c_master_transmit(uint8_t addr7, const uint8_t *data, uint16_t size)
+{
+    (void)addr7;
+    if (size == 2 && data[0] == HTU21_WRITEREG) user_reg = data[1];
+    else triggers++;
+    return I2C_OK;
+}
+
+int i2c_master_receive(uint8_t addr7, uint8_t *data, uint16_t size)
+{
+    uint8_t kind;
+
+    (void)addr7;
+    if (reply_head == reply_tail) return I2C_ERR_NACK;
+
+    kind = replies[reply_head].kind;
+    if (kind == REPLY_FRAME) memcpy(data, replies[reply_head].frame, size);
+    reply_head = (uint8_t)((reply_head + 1u) & 7u);
+
+    return kind == REPLY_FRAME ? I2C_OK : kind == REPLY_NACK ? I2C_ERR_NACK : I2C_ERR_BUS;
+}
+
+int i2c_master_transfer(uint8_t addr7, const uint8_t *tx, uint16_t tx_len,
+                        uint8_t *rx, uint16_t rx_len)
+{
+    (void)addr7;
+    // read user register
+    if (tx_len == 1 && tx[0] == HTU21_READREG && rx_len == 1) rx[0] = user_reg;
+    return I2C_OK;
+}
+
+void delay_ms(uint16_t ms) { (void)ms; }
+uint32_t millis(void) { return 0; }
+uint8_t systick_running(void) { return 0; }
+
+/* ================= TESTS ================= */
+/*
+ * All 65536 raw codes: the status bits (1..0) are cleared first, as the
+ * datasheet requires, so codes differing only in them convert alike.
+ */
+static void test_conversion(void)
+{
+    double t_err = 0, rh_err = 0;
+    double ref, err;
+    unsigned t_worst = 0, rh_worst = 0;
+    unsigned raw;
+    unsigned m;
+
+    for (raw = 0; raw < 0x10000u; raw++)
+    {
+        m = raw & 0xFFFCu;
+
+        ref = (-46.85 + 175.72 * m / 65536.0) * 100.0;
+        err = fabs(htu21_temp_c100((uint16_t)raw) - ref);
+        if (err > t_err) { t_err = err; t_worst = raw; }
+
+        ref = (-6.0 + 125.0 * m / 65536.0) * 100.0;
+        err = fabs(htu21_hum_c100((uint16_t)raw) - ref);
+        if (err > rh_err) { rh_err = err; rh_worst = raw; }
+    }
+
+    printf("  65536 raw codes: max error %.4f (0.01 degC) at 0x%04X, "
+           "%.4f (0.01 %%RH) at 0x%04X\n", t_err, t_worst, rh_err, rh_worst);
+
+    // rounded to the nearest output LSB (exact ties may go either way)
+    CHECK(t_err <= 0.5 + 1e-9);
+    CHECK(rh_err <= 0.5 + 1e-9);
+
+    // range ends
+    CHECK(htu21_temp_c100(0x0000) == -4685);
+    CHECK(htu21_temp_c100(0xFFFF) == 12886);
+    CHECK(htu21_hum_c100(0x0000) == -600);
+    CHECK(htu21_hum_c100(0xFFFF) == 11899);
+}
+
+/*
+ * Datasheet example frame: 0x683A (status bits 10, i.e. temperature)
+ * with CRC 0x7C, 24.7 degC.
+ */
+static void test_crc_retry(void)
+{
+    htu21_errors_t e;
+
+    htu21_reset_errors();
+    reply_head = reply_tail = 0;
+    triggers = 0;
+
+    // good frame after one NACK
+    CHECK(htu21_trigger(HTU21_MEAS_TEMP) == 0);
+    reply(REPLY_NACK, 0, 0, 0);
+    reply(REPLY_FRAME, 0x68, 0x3A, 0x7C);
+    CHECK(htu21_poll() == HTU21_BUSY);
+    CHECK(htu21_poll() == 0);
+    CHECK(htu21_last_temperature_c100() == 2469);
+    htu21_get_errors(&e);
+    CHECK(e.crc == 0 && e.i2c == 0 && e.retries == 0);
+
+    // corrupted CRC, then a bus error, then the frame: two re-triggers
+    CHECK(htu21_trigger(HTU21_MEAS_TEMP) == 0);
+    reply(REPLY_FRAME, 0x68, 0x3B, 0x7C);
+    reply(REPLY_ERR, 0, 0, 0);
+    reply(REPLY_FRAME, 0x70, 0x00, 0x00);
+    CHECK(htu21_poll() == HTU21_BUSY);
+    CHECK(htu21_poll() == HTU21_BUSY);
+    htu21_get_errors(&e);
+    CHECK(e.crc == 1 && e.i2c == 1 && e.retries == 2);
+    CHECK(triggers == 4);
+
+    // retries exhausted: the cached value is kept
+    CHECK(htu21_poll() == -1);
+    htu21_get_errors(&e);
+    CHECK(e.crc == 2 && e.retries == HTU21_RETRIES);
+    CHECK(htu21_last_temperature_c100() == 2469);
+
+    htu21_reset_errors();
+    htu21_get_errors(&e);
+    CHECK(e.crc == 0 && e.i2c == 0 && e.timeout == 0 && e.retries == 0);
+}
+
+#if HTU21_USER_REG_API
+/* Resolution changes keep the other register bits and the waits follow them */
+static void test_user_reg(void)
+{
+    CHECK(htu21_conv_time_ms(HTU21_MEAS_TEMP) == 50);
+    CHECK(htu21_conv_time_ms(HTU21_MEAS_HUM) == 16);
+
+    user_reg = 0x3A;   /* heater on, OTP reload off, battery bit, RH12/T14 */
+    CHECK(htu21_set_resolution(HTU21_RES_FAST) == 0);
+    CHECK(user_reg == 0x3B);
+    CHECK(htu21_get_resolution() == HTU21_RES_RH8_T12);
+    CHECK(htu21_conv_time_ms(HTU21_MEAS_TEMP) == 13);
+    CHECK(htu21_conv_time_ms(HTU21_MEAS_HUM) == 3);
+
+    CHECK(htu21_set_resolution(HTU21_RES_RH10_T13) == 0);
+    CHECK(user_reg == 0xBA);
+    CHECK(htu21_conv_time_ms(HTU21_MEAS_HUM) == 5);
+
+    CHECK(htu21_set_resolution(HTU21_RES_DEFAULT) == 0);
+    CHECK(user_reg == 0x3A);
+}
+#endif
+
+int main(void)
+{
+    test_conversion();
+    test_crc_retry();
+#if HTU21_USER_REG_API
+    test_user_reg();
+#endif
+
+    printf("%s\n", sim_failures ? "FAILED" : "OK");
+    return sim_failures != 0;
+}
@@ -0,0 +1,472 @@
+/*
+ * I2C transaction engine against a simulated STM8 I2C peripheral.
+ *
+ * The model works at byte level: each step of the bus puts a START,
+ * an address byte, a data byte or a STOP on the wire and appends it to
+ * a log, e.g. "S A81+ R5A- P" (START, read address acknowledged, byte
+ * 0x5A received and NACKed by the master, STOP). Flags are set and
+ * cleared the way the reference manual describes (SB by the DR write,
+ * ADDR by reading SR3, RXNE by reading DR), and the ACK bit is sampled
+ * when a received byte completes, so the log shows exactly which byte
+ * the driver NACKs and where its STOP lands. The ISR is called whenever
+ * an enabled interrupt is pending, i.e. with zero latency.
+ *
+ * Bus time is accumulated from the programmed FREQR/CCR/CCRH: 9 SCL
+ * periods per byte, one per START, repeated START and STOP. Clock
+ * stretching and the ISR latency are not modelled, so the throughput
+ * table at the end is an upper bound for the programmed clock.
+ */
+#include <string.h>
+#include "i2c_driver.h"
+#include "stm8_s.h"
+
+void I2C_IRQHandler(void);
+
+#if CLOCK_SCALING_ENABLE
+uint32_t clock_profile_hz(uint8_t id) { return F_CPU >> id; }
+#endif
+
+/* ================= SLAVE ================= */
+static struct {
+    uint8_t addr7;
+    uint8_t nack_addr;      /* NACK the address byte */
+    uint8_t nack_at;        /* NACK the n-th written data byte (1-based), 0 = never */
+    uint8_t rx[16];         /* bytes sent to the master on reads */
+    uint8_t rx_pos;
+    uint8_t written;        /* data bytes written in this transaction */
+} slave;
+
+/* ================= PERIPHERAL MODEL ================= */
+/* The model reads and writes sim_mem[] directly so it does not trigger its own hook */
+#define M_CR2   sim_mem[I2C_BASE + 0x01]
+#define M_FREQR sim_mem[I2C_BASE + 0x02]
+#define M_DR    sim_mem[I2C_BASE + 0x06]
+#define M_SR1   sim_mem[I2C_BASE + 0x07]
+#define M_SR2   sim_mem[I2C_BASE + 0x08]
+#define M_ITR   sim_mem[I2C_BASE + 0x0A]
+#define M_CCRL  sim_mem[I2C_BASE + 0x0B]
+#define M_CCRH  sim_mem[I2C_BASE + 0x0C]
+
+#define PH_IDLE 0   /* bus free */
+#define PH_SB   1   /* START sent, waiting for the address in DR */
+#define PH_ADDR 2   /* address acknowledged, ADDR set */
+#define PH_TX   3   /* transmitter */
+#define PH_RX   4   /* receiver */
+#define PH_NACK 5   /* address or data NACKed, waiting for STOP */
+
+static struct {
+    uint8_t phase;
+    uint8_t shift_full;   /* TX: byte in the shift register; RX: byte waiting for DR */
+    uint8_t shift;
+    uint8_t dr_full;      /* TX: DR holds a byte not yet in the shift register */
+    uint8_t rx_on;        /* RX: clocking in the next byte */
+    uint8_t dr_access;    /* DR touched since the last commit */
+    uint8_t addr_ack;     /* CR2 ACK bit when ADDR was cleared */
+    uint8_t addr_stop;    /* CR2 STOP bit when ADDR was cleared */
+    double  ns;           /* bus time */
+} hw;
+
+static char bus_log[512];
+
+static void log_add(const char *fmt, unsigned v, char ack)
+{
+    char tok[16];
+
+    sprintf(tok, fmt, v, ack);
+    if (bus_log[0]) strcat(bus_log, " ");
+    strcat(bus_log, tok);
+}
+
+/* Length of one SCL period programmed in the peripheral, ns */
+static double scl_ns(void)
+{
+    unsigned ccr = ((M_CCRH & 0x0Fu) << 8) | M_CCRL;
+    unsigned div;
+
+    if (!(M_CCRH & I2C_CCRH_FS))      div = 2;
+    else if (M_CCRH & I2C_CCRH_DUTY)  div = 25;
+    else                              div = 3;
+
+    return 1000.0 * div * ccr / M_FREQR;
+}
+
+/* Register reads that clear flags; called before the access happens */
+static void hw_access(uint16_t addr)
+{
+    if (addr == I2C_BASE + 0x06) hw.dr_access = 1;
+
+    // ADDR is cleared by reading SR1 and then SR3
+    if (addr == I2C_BASE + 0x09 && (M_SR1 & I2C_SR1_ADDR))
+    {
+        M_SR1 &= (uint8_t)~I2C_SR1_ADDR;
+        hw.addr_ack  = (uint8_t)(M_CR2 & I2C_CR2_ACK);
+        hw.addr_stop = (uint8_t)(M_CR2 & I2C_CR2_STOP);
+        if (hw.phase == PH_ADDR)
+        {
+            if (slave.rx_pos == 0xFF) { hw.phase = PH_TX; M_SR1 |= I2C_SR1_TXE; }
+            else                      { hw.phase = PH_RX; hw.rx_on = 1; }
+        }
+    }
+}
+
+/* Applies the DR access of the last ISR run (no bus time) */
+static void hw_commit(void)
+{
+    if (!hw.dr_access) return;
+    hw.dr_access = 0;
+
+    switch (hw.phase)
+    {
+    case PH_SB:
+        // address byte: SB cleared by the DR write
+        M_SR1 &= (uint8_t)~I2C_SR1_SB;
+        hw.ns += 9 * scl_ns();
+        if ((M_DR >> 1) != slave.addr7 || slave.nack_addr)
+        {
+            log_add("A%02X%c", M_DR, '-');
+            M_SR2 |= I2C_SR2_AF;
+            hw.phase = PH_NACK;
+            break;
+        }
+        log_add("A%02X%c", M_DR, '+');
+        slave.rx_pos  = (M_DR & 1u) ? 0 : 0xFF;
+        slave.written = 0;
+        M_SR1 |= I2C_SR1_ADDR;
+        hw.phase = PH_ADDR;
+        break;
+
+    case PH_TX:
+        M_SR1 &= (uint8_t)~I2C_SR1_BTF;
+        if (!hw.shift_full) { hw.shift = M_DR; hw.shift_full = 1; }
+        else                { hw.dr_full = 1; M_SR1 &= (uint8_t)~I2C_SR1_TXE; }
+        break;
+
+    case PH_RX:
+        // DR read: a byte held back by BTF moves up
+        M_SR1 &= (uint8_t)~(I2C_SR1_RXNE | I2C_SR1_BTF);
+        if (hw.shift_full)
+        {
+            M_DR = hw.shift;
+            M_SR1 |= I2C_SR1_RXNE;
+            hw.shift_full = 0;
+        }
+        break;
+    }
+}
+
+/* Generates a requested START or STOP once the current byte is out */
+static int hw_condition(void)
+{
+    // STOP once the current byte is out
+    if ((M_CR2 & I2C_CR2_STOP) && hw.phase != PH_IDLE && hw.phase != PH_SB &&
+        hw.phase != PH_ADDR && !hw.shift_full && !hw.rx_on)
+    {
+        log_add("P", 0, 0);
+        M_CR2 &= (uint8_t)~I2C_CR2_STOP;
+        M_SR1 = 0;
+        hw.phase = PH_IDLE;
+        hw.dr_full = 0;
+        hw.ns += scl_ns();
+        return 1;
+    }
+
+    // START / repeated START once the current byte is out
+    if ((M_CR2 & I2C_CR2_START) && !hw.shift_full && !hw.rx_on &&
+        (hw.phase == PH_IDLE || hw.phase == PH_TX || hw.phase == PH_RX))
+    {
+        log_add(hw.phase == PH_IDLE ? "S" : "Sr", 0, 0);
+        M_CR2 &= (uint8_t)~I2C_CR2_START;
+        M_SR1 = I2C_SR1_SB;
+        hw.phase = PH_SB;
+        hw.ns += scl_ns();
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Puts the next event on the bus; returns 0 if there is nothing to do */
+static int hw_step(void)
+{
+    uint8_t b;
+    uint8_t ack;
+
+    if (hw_condition()) return 1;
+
+    if (hw.phase == PH_TX && hw.shift_full)
+    {
+        hw.ns += 9 * scl_ns();
+        slave.written++;
+        if (slave.nack_at && slave.written == slave.nack_at)
+        {
+            log_add("W%02X%c", hw.shift, '-');
+            hw.shift_full = 0;
+            hw.dr_full = 0;
+            M_SR2 |= I2C_SR2_AF;
+            hw.phase = PH_NACK;
+            return 1;
+        }
+        log_add("W%02X%c", hw.shift, '+');
+        if (hw.dr_full)
+        {
+            hw.shift = M_DR;
+            hw.dr_full = 0;
+            M_SR1 |= I2C_SR1_TXE;
+        }
+        else
+        {
+            hw.shift_full = 0;
+            M_SR1 |= I2C_SR1_BTF;
+        }
+        return 1;
+    }
+
+    if (hw.phase == PH_RX && hw.rx_on && !hw.shift_full)
+    {
+        // the master answers the byte with the ACK bit set at this moment
+        b   = slave.rx[slave.rx_pos++ & 15u];
+        ack = (uint8_t)(M_CR2 & I2C_CR2_ACK);
+        log_add("R%02X%c", b, ack ? '+' : '-');
+        hw.ns += 9 * scl_ns();
+        if (M_SR1 & I2C_SR1_RXNE) { hw.shift = b; hw.shift_full = 1; M_SR1 |= I2C_SR1_BTF; }
+        else                        { M_DR = b; M_SR1 |= I2C_SR1_RXNE; }
+        hw.rx_on = ack;
+        return 1;
+    }
+
+    return 0;
+}
+
+static int irq_pending(void)
+{
+    uint8_t itr = M_ITR;
+    uint8_t sr1 = M_SR1;
+
+    if ((itr & I2C_ITR_ITERREN) && (M_SR2 & I2C_SR2_ERRORS)) return 1;
+    if (!(itr & I2C_ITR_ITEVTEN)) return 0;
+    if (sr1 & (I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_BTF)) return 1;
+    return (itr & I2C_ITR_ITBUFEN) && (sr1 & (I2C_SR1_TXE | I2C_SR1_RXNE));
+}
+
+/* Runs bus and ISR until nothing moves */
+static void run(void)
+{
+    int n;
+
+    for (n = 0; n < 2000; n++)
+    {
+        if (irq_pending())
+        {
+            I2C_IRQHandler();
+            hw_commit();
+            // BTF stays set until the START/STOP it asked for is generated
+            hw_condition();
+        }
+        else if (!hw_step())
+        {
+            return;
+        }
+    }
+    printf("bus did not settle\n");
+    sim_failures++;
+}
+
+static void reset(uint32_t cpu_hz, uint32_t i2c_hz)
+{
+    sim_reset();
+    memset(&hw, 0, sizeof(hw));
+    memset(&slave, 0, sizeof(slave));
+    sim_on_access = hw_access;
+    slave.addr7 = 0x40;
+    i2c_master_init(cpu_hz, i2c_hz);
+    bus_log[0] = 0;
+}
+
+/* ================= TESTS ================= */
+static int done_calls;
+static void on_done(i2c_xfer_t *x) { (void)x; done_calls++; }
+
+static void xfer_set(i2c_xfer_t *x, uint8_t addr7, const uint8_t *tx, uint16_t tx_len,
+                     uint8_t *rx, uint16_t rx_len)
+{
+    x->addr7  = addr7;
+    x->tx_buf = tx;
+    x->tx_len = tx_len;
+    x->rx_buf = rx;
+    x->rx_len = rx_len;
+    x->done   = on_done;
+}
+
+/* Runs one transaction and compares the bus log */
+static void expect(const char *name, uint16_t tx_len, uint16_t rx_len,
+                   int status, const char *log)
+{
+    static const uint8_t tx[] = {0x01, 0x02, 0x03, 0x04};
+    uint8_t rx[8];
+    i2c_xfer_t x;
+
+    memset(rx, 0, sizeof(rx));
+    xfer_set(&x, slave.addr7, tx, tx_len, rx, rx_len);
+    done_calls = 0;
+    CHECK(i2c_submit(&x) == 0);
+    run();
+
+    if (strcmp(bus_log, log) != 0 || x.status != status)
+    {
+        printf("%s: got \"%s\" status %d, want \"%s\" status %d\n",
+               name, bus_log, x.status, log, status);
+        sim_failures++;
+    }
+    CHECK(done_calls == 1);
+    CHECK(!i2c_busy());
+    if (status == I2C_OK && rx_len)
+        CHECK(memcmp(rx, slave.rx, rx_len) == 0);
+    bus_log[0] = 0;
+}
+
+static void test_sequences(void)
+{
+    static const uint8_t data[] = {0x5A, 0x5B, 0x5C, 0x5D};
+
+    reset(F_CPU, 100000UL);
+    memcpy(slave.rx, data, sizeof(data));
+
+    expect("write 3", 3, 0, I2C_OK, "S A80+ W01+ W02+ W03+ P");
+    expect("probe", 0, 0, I2C_OK, "S A80+ P");
+
+    // N = 1: ACK cleared before ADDR, STOP after it
+    expect("read 1", 0, 1, I2C_OK, "S A81+ R5A- P");
+    CHECK(hw.addr_ack == 0);
+    CHECK(hw.addr_stop == 0);
+
+    // N = 2: ACK kept at ADDR, the second byte is the NACKed one
+    expect("read 2", 0, 2, I2C_OK, "S A81+ R5A+ R5B- P");
+    CHECK(hw.addr_ack != 0);
+
+    expect("read 3", 0, 3, I2C_OK, "S A81+ R5A+ R5B+ R5C- P");
+    expect("write 1 read 3", 1, 3, I2C_OK, "S A80+ W01+ Sr A81+ R5A+ R5B+ R5C- P");
+    expect("write 2 read 1", 2, 1, I2C_OK, "S A80+ W01+ W02+ Sr A81+ R5A- P");
+
+    slave.nack_addr = 1;
+    expect("address NACK", 2, 0, I2C_ERR_NACK, "S A80- P");
+    expect("read address NACK", 0, 3, I2C_ERR_NACK, "S A81- P");
+    slave.nack_addr = 0;
+
+    slave.nack_at = 2;
+    expect("data NACK", 3, 0, I2C_ERR_NACK, "S A80+ W01+ W02- P");
+    slave.nack_at = 0;
+
+    // the engine is usable again after errors
+    expect("write after errors", 1, 0, I2C_OK, "S A80+ W01+ P");
+}
+
+static void test_queue(void)
+{
+    static const uint8_t tx[] = {0x11, 0x22};
+    uint8_t rx[2];
+    i2c_xfer_t x[I2C_QUEUE_LEN + 2];
+    uint8_t i;
+
+    reset(F_CPU, 100000UL);
+    slave.rx[0] = 0x77;
+    slave.rx[1] = 0x78;
+
+    // the first one starts at once, I2C_QUEUE_LEN more wait, the next is refused
+    for (i = 0; i < I2C_QUEUE_LEN + 2; i++)
+        xfer_set(&x[i], 0x40, tx, 2, 0, 0);
+    xfer_set(&x[1], 0x40, 0, 0, rx, 2);
+
+    done_calls = 0;
+    for (i = 0; i < I2C_QUEUE_LEN + 1; i++)
+        CHECK(i2c_submit(&x[i]) == 0);
+    CHECK(i2c_submit(&x[I2C_QUEUE_LEN + 1]) == I2C_ERR_FULL);
+    CHECK(i2c_busy());
+
+    run();
+
+    for (i = 0; i < I2C_QUEUE_LEN + 1; i++)
+        CHECK(x[i].status == I2C_OK);
+    CHECK(done_calls == I2C_QUEUE_LEN + 1);
+    CHECK(rx[0] == 0x77 && rx[1] == 0x78);
+    CHECK(!i2c_busy());
+    CHECK(strncmp(bus_log, "S A80+ W11+ W22+ P S A81+ R77+ R78- P S A80+", 44) == 0);
+}
+
+static void test_stats(void)
+{
+    static const uint8_t tx[] = {0x01, 0x02, 0x03};
+    uint8_t rx[2];
+    i2c_stats_t st;
+    i2c_xfer_t x;
+
+    reset(F_CPU, 100000UL);
+    i2c_reset_stats();
+
+    xfer_set(&x, 0x40, tx, 3, rx, 2);
+    i2c_submit(&x);
+    run();
+
+    // 2 STARTs; 2 address + 3 written + 2 read bytes
+    i2c_get_stats(&st);
+    CHECK(st.starts == 2);
+    CHECK(st.bytes == 7);
+}
+
+/* ================= TIMING ================= */
+static void test_timing(void)
+{
+    static const struct { uint32_t cpu_hz; uint32_t i2c_hz; } cfg[] = {
+        { 16000000UL,  10000UL }, { 16000000UL, 100000UL }, { 16000000UL, 400000UL },
+        {  8000000UL, 400000UL }, {  4000000UL, 400000UL }, {  2000000UL, 400000UL },
+        {  2000000UL, 100000UL },
+    };
+    static uint8_t row[64];
+    i2c_xfer_t x;
+    double bps;
+    uint32_t hz;
+    uint8_t i;
+
+    printf("  fMASTER  request    SCL   LCD row (65 bytes on the bus)\n");
+    for (i = 0; i < sizeof(cfg) / sizeof(cfg[0]); i++)
+    {
+        reset(cfg[i].cpu_hz, cfg[i].i2c_hz);
+        hz = i2c_bus_hz();
+
+        // never faster than requested, and fast mode only from 4 MHz
+        CHECK(hz <= cfg[i].i2c_hz);
+        if (cfg[i].cpu_hz < 4000000UL) CHECK(hz <= I2C_SM_MAX_HZ);
+        CHECK(I2C_TRISER == (hz > I2C_SM_MAX_HZ ? cfg[i].cpu_hz / 1000000UL * 3 / 10 + 1
+                                                : cfg[i].cpu_hz / 1000000UL + 1));
+
+        // one streamed 16-character LCD row: address + 64 expander bytes
+        slave.addr7 = LCD_ADDR;
+        xfer_set(&x, LCD_ADDR, row, sizeof(row), 0, 0);
+        i2c_submit(&x);
+        run();
+        CHECK(x.status == I2C_OK);
+
+        bps = (sizeof(row) + 1) / (hw.ns * 1e-9);
+        printf("  %2lu MHz  %6lu  %6lu  %6.0f bytes/s, %5.2f ms\n",
+               (unsigned long)(cfg[i].cpu_hz / 1000000UL), (unsigned long)cfg[i].i2c_hz,
+               (unsigned long)hz, bps, hw.ns * 1e-6);
+    }
+
+    // the settings main.c picks for LCD + HTU21: PCF8574 limits the bus to 100 kHz
+    {
+        static const uint32_t dev[] = {LCD_I2C_MAX_HZ, HTU21_I2C_MAX_HZ};
+        CHECK(i2c_select_speed(dev, 2) == 100000UL);
+        CHECK(i2c_select_speed(dev + 1, 1) == 400000UL);
+        CHECK(i2c_select_speed(dev, 0) == I2C_FM_MAX_HZ);
+    }
+}
+
+int main(void)
+{
+    test_sequences();
+    test_queue();
+    test_stats();
+    test_timing();
+
+    printf("%s\n", sim_failures ? "FAILED" : "OK");
+    return sim_failures != 0;
+}
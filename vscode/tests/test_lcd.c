@@ -0,0 +1,323 @@
+/*
+ * LCD API against a model of the PCF8574 expander and the HD44780.
+ *
+ * The I2C transfer functions are replaced by a bus that feeds every
+ * expander byte to an HD44780 model (4-bit mode, latched on the falling
+ * edge of EN) and counts START conditions and bytes the same way the
+ * I2C_STATS counters of the driver do: one START per write or read
+ * phase, one byte per address, data or received byte. test_i2c checks
+ * that the driver counters follow this rule on the simulated bus.
+ *
+ * The benchmark renders a 16x2 screen through each path and prints the
+ * measured counts.
+ */
+#include <string.h>
+#include "lcd_api.h"
+#include "i2c_driver.h"
+#include "delay.h"
+#include "numfmt.h"
+
+/* ================= BUS ================= */
+static unsigned long bus_starts;
+static unsigned long bus_bytes;
+static unsigned long bus_ms;        /* delay_ms() total */
+
+/* Busy flag: reads left that report busy, or RW tied to GND (never readable) */
+static unsigned hd_busy;
+static uint8_t  hd_rw_gnd;
+
+/* ================= HD44780 ================= */
+static struct {
+    uint8_t four_bit;
+    uint8_t pins;       /* last expander output */
+    uint8_t hi;         /* first nibble of a 4-bit byte */
+    uint8_t half;       /* 1 after the first nibble */
+    uint8_t addr;       /* DDRAM address counter */
+    char    ddram[0x80];
+} hd;
+
+static void hd_byte(uint8_t val, uint8_t rs)
+{
+    if (rs)
+    {
+        hd.ddram[hd.addr & 0x7F] = (char)val;
+        hd.addr++;
+    }
+    else if (val & 0x80)
+    {
+        hd.addr = (uint8_t)(val & 0x7F);
+    }
+    else if (val == 0x01)
+    {
+        memset(hd.ddram, ' ', sizeof(hd.ddram));
+        hd.addr = 0;
+    }
+    else if ((val & 0xF0) == 0x20)
+    {
+        hd.four_bit = 1;
+    }
+}
+
+/* One expander output byte: the LCD latches D7..D4 when EN falls */
+static void hd_pins(uint8_t pins)
+{
+    uint8_t fell = (uint8_t)((hd.pins & PIN_EN) && !(pins & PIN_EN));
+
+    hd.pins = pins;
+    if (!fell || (pins & PIN_RW)) return;
+
+    if (!hd.four_bit)
+    {
+        hd_byte((uint8_t)(pins & 0xF0), 0);
+        return;
+    }
+    if (!hd.half)
+    {
+        hd.hi = (uint8_t)(pins & 0xF0);
+        hd.half = 1;
+        return;
+    }
+    hd.half = 0;
+    hd_byte((uint8_t)(hd.hi | (pins >> 4)), (uint8_t)(pins & PIN_RS));
+}
+
+/* Text shown on one row */
+static const char *hd_row(uint8_t row)
+{
+    static char line[LCD_COLS + 1];
+
+    memcpy(line, &hd.ddram[row ? 0x40 : 0x00], LCD_COLS);
+    line[LCD_COLS] = 0;
+    return line;
+}
+
+/* ================= STUBS ================= */
+int i2c_master_transfer(uint8_t addr7, const uint8_t *tx, uint16_t tx_len,
+                        uint8_t *rx, uint16_t rx_len)
+{
+    uint16_t i;
+
+    (void)addr7;
+    if (tx_len != 0u || rx_len == 0u)
+    {
+        bus_starts++;
+        bus_bytes += 1u + tx_len;
+        for (i = 0; i < tx_len; i++) hd_pins(tx[i]);
+    }
+    if (rx_len != 0u)
+    {
+        // expander input: D7 is the busy flag; with RW grounded the LCD
+        // never drives the bus and the released pin reads high
+        bus_starts++;
+        bus_bytes += 1u + rx_len;
+        for (i = 0; i < rx_len; i++)
+        {
+            if (hd_rw_gnd || hd_busy) rx[i] = (uint8_t)(hd.pins | PIN_D7);
+            else rx[i] = (uint8_t)(hd.pins & ~PIN_D7);
+            if (hd_busy) hd_busy--;
+        }
+    }
+    return I2C_OK;
+}
+
+int i2c_master_transmit(uint8_t addr7, const uint8_t *data, uint16_t size)
+{
+    return i2c_master_transfer(addr7, data, size, 0, 0);
+}
+
+void delay_ms(uint16_t ms) { bus_ms += ms; }
+void delay_loops(uint16_t n) { (void)n; }
+
+/* ================= TESTS ================= */
+static const char screen[LCD_ROWS][LCD_COLS + 1] = {
+    "CO2  612 ppm    ",
+    "T 23.4C  RH 41% ",
+};
+
+static void bench_reset(void)
+{
+    bus_starts = 0;
+    bus_bytes  = 0;
+    bus_ms     = 0;
+}
+
+static void bench_print(const char *name)
+{
+    printf("  %-32s %3lu STARTs %4lu bytes\n", name, bus_starts, bus_bytes);
+}
+
+static void check_screen(void)
+{
+    CHECK(strcmp(hd_row(0), screen[0]) == 0);
+    CHECK(strcmp(hd_row(1), screen[1]) == 0);
+}
+
+static void test_render(void)
+{
+    uint8_t row;
+    uint8_t col;
+
+    memset(&hd, 0, sizeof(hd));
+    lcd_init();
+    CHECK(hd.four_bit);
+    CHECK(strcmp(hd_row(0), "                ") == 0);
+
+    printf("  per rendered 16x2 screen:\n");
+
+    // one transaction per character (the path lcd_send_string() used to take)
+    memset(hd.ddram, ' ', sizeof(hd.ddram));
+    bench_reset();
+    for (row = 0; row < LCD_ROWS; row++)
+    {
+        lcd_send_cmd((char)(0x80 | (row ? 0x40 : 0x00)));
+        for (col = 0; col < LCD_COLS; col++) lcd_send_data(screen[row][col]);
+    }
+    bench_print("per character");
+    check_screen();
+    CHECK(bus_starts == 34 && bus_bytes == 170);
+
+    // one streamed transaction per row
+    memset(hd.ddram, ' ', sizeof(hd.ddram));
+    bench_reset();
+    for (row = 0; row < LCD_ROWS; row++)
+    {
+        lcd_send_cmd((char)(0x80 | (row ? 0x40 : 0x00)));
+        lcd_write(screen[row], LCD_COLS);
+    }
+    bench_print("streamed rows");
+    check_screen();
+    CHECK(bus_starts == 4 && bus_bytes == 140);
+
+    // framebuffer, every cell changed
+    memset(hd.ddram, ' ', sizeof(hd.ddram));
+    lcd_invalidate();
+    for (row = 0; row < LCD_ROWS; row++)
+    {
+        lcd_put_cur(row, 0);
+        lcd_send_string((char *)screen[row]);
+    }
+    bench_reset();
+    CHECK(lcd_flush() == 0);
+    bench_print("lcd_flush(), full redraw");
+    check_screen();
+    CHECK(bus_starts == 4 && bus_bytes == 140);
+
+    // framebuffer, same screen again: nothing to send
+    for (row = 0; row < LCD_ROWS; row++)
+    {
+        lcd_put_cur(row, 0);
+        lcd_send_string((char *)screen[row]);
+    }
+    bench_reset();
+    CHECK(lcd_flush() == LCD_ROWS * LCD_COLS);
+    bench_print("lcd_flush(), unchanged");
+    CHECK(bus_starts == 0 && bus_bytes == 0);
+
+    // framebuffer, one digit of the CO2 reading changed
+    lcd_put_cur(0, 7);
+    lcd_send_string("5");
+    bench_reset();
+    CHECK(lcd_flush() == LCD_ROWS * LCD_COLS - 1);
+    bench_print("lcd_flush(), one cell changed");
+    CHECK(hd_row(0)[7] == '5');
+    CHECK(bus_starts == 2 && bus_bytes == 10);
+}
+
+#if LCD_BUSY_FLAG
+/* Clear waits on the busy flag, or the fixed 2 ms when it cannot be read */
+static void test_busy_flag(void)
+{
+    // flag readable: no fixed waits after the 4-bit switch
+    memset(&hd, 0, sizeof(hd));
+    hd_rw_gnd = 0;
+    bench_reset();
+    lcd_init();
+    CHECK(lcd_busy_flag_ok());
+    CHECK(bus_ms == 50 + 5);
+
+    // clear returns once the flag drops
+    hd_busy = 3;
+    bench_reset();
+    lcd_send_cmd(0x01);
+    CHECK(bus_ms == 0 && hd_busy == 0);
+    CHECK(lcd_busy_flag_ok());
+    printf("  clear with busy flag: %lu STARTs %lu bytes, 0 ms fixed wait\n",
+           bus_starts, bus_bytes);
+
+    // RW tied to GND: probe fails once, then fixed delays without reads
+    memset(&hd, 0, sizeof(hd));
+    hd_rw_gnd = 1;
+    bench_reset();
+    lcd_init();
+    CHECK(!lcd_busy_flag_ok());
+    CHECK(bus_ms == 50 + 5 + 1 + 2);
+    CHECK(strcmp(hd_row(0), "                ") == 0);
+
+    bench_reset();
+    lcd_send_cmd(0x01);
+    CHECK(bus_ms == 2 && bus_starts == 1);
+    hd_rw_gnd = 0;
+}
+#endif
+
+/* ================= NUMBER FORMATTING ================= */
+static char   fmt_text[32];
+static uint8_t fmt_len;
+
+static void fmt_collect(char c)
+{
+    fmt_text[fmt_len++] = c;
+}
+
+/* Formats through the output callback and compares the text and count */
+static void check_fmt(int32_t value, uint8_t decimals, uint8_t width, char pad, const char *want)
+{
+    uint8_t n;
+
+    memset(fmt_text, 0, sizeof(fmt_text));
+    fmt_len = 0;
+    n = fmt_fixed(fmt_collect, value, decimals, width, pad);
+    CHECK(strcmp(fmt_text, want) == 0);
+    CHECK(n == fmt_len);
+}
+
+static void test_fixed(void)
+{
+    check_fmt(2345, 2, 0, ' ', "23.45");
+    check_fmt(-5, 1, 0, ' ', "-0.5");
+    check_fmt(42, 0, 5, ' ', "   42");
+    check_fmt(-42, 0, 5, '0', "-0042");
+    check_fmt(0, 0, 0, ' ', "0");
+    check_fmt(7, 3, 0, ' ', "0.007");
+    check_fmt(123456789, 9, 0, ' ', "0.123456789");
+    check_fmt(1000000000, 0, 0, ' ', "1000000000");
+    check_fmt(-2147483647 - 1, 0, 0, ' ', "-2147483648");
+    check_fmt(-2147483647 - 1, 1, 0, ' ', "-214748364.8");
+    check_fmt(2345, 2, 3, ' ', "23.45");
+
+    // lcd_send_fixed() draws into the framebuffer, clipped at the row end
+    memset(&hd, 0, sizeof(hd));
+    lcd_init();
+    lcd_clear();
+    lcd_put_cur(0, 0);
+    lcd_send_fixed(2345, 2, 6);
+    lcd_send_fixed(-7, 1, 5);
+    lcd_put_cur(1, 12);
+    lcd_send_fixed(-123456, 0, 0);
+    lcd_invalidate();
+    CHECK(lcd_flush() == 0);
+    CHECK(strcmp(hd_row(0), " 23.45 -0.7     ") == 0);
+    CHECK(strcmp(hd_row(1), "            -123") == 0);
+}
+
+int main(void)
+{
+    test_render();
+#if LCD_BUSY_FLAG
+    test_busy_flag();
+#endif
+    test_fixed();
+
+    printf("%s\n", sim_failures ? "FAILED" : "OK");
+    return sim_failures != 0;
+}
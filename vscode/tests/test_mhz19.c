@@ -0,0 +1,374 @@
+/*
+ * MH-Z19B PWM backend (input capture): extended timebase across TIM2
+ * wraparounds.
+ *
+ * The test drives a simulated TIM2: the counter follows a 64-bit tick
+ * clock, every wrap sets UIF, each PWM edge latches the counter into
+ * CCR1 (falling) or CCR2 (rising) and sets the flag. The ISRs run after
+ * a configurable latency, and the update ISR can be held back to
+ * reproduce a capture ISR that sees a wrapped counter with UIF still
+ * pending. Edge times are synthetic; the expected ppm comes from the
+ * datasheet formula on the exact high time and period.
+ */
+#include "mh-z19b.h"
+#include "tim2_driver.h"
+#include "clock.h"
+#include "power.h"
+#include <math.h>
+
+void TIM2_UPD_OVF_IRQHandler(void);
+void TIM2_CAP_COM_IRQHandler(void);
+
+/* ================= STUBS ================= */
+void power_lock(uint8_t mask) { (void)mask; }
+uint8_t clock_timer_psc(void) { return 6; }
+
+/* ================= TIM2 MODEL ================= */
+#define T_MS(ms) ((uint64_t)((ms) * 1000.0 / MHZ19_TICK_US + 0.5))
+
+static uint64_t now;          /* ticks */
+static uint8_t  hold_update;  /* update ISR held back (another ISR running) */
+
+#define R_SR1 sim_mem[0x5304]
+
+/* Reading CCRxL clears the capture flag */
+static void tim2_access(uint16_t addr)
+{
+    if (addr == 0x5312) R_SR1 &= (uint8_t)~TIM2_SR1_CC1IF;
+    if (addr == 0x5314) R_SR1 &= (uint8_t)~TIM2_SR1_CC2IF;
+}
+
+static void update_isr(void)
+{
+    uint8_t sr = R_SR1;
+
+    TIM2_UPD_OVF_IRQHandler();
+    // the driver writes ~UIF; writing 1 to the other flags has no effect
+    R_SR1 = (uint8_t)(sr & ~TIM2_SR1_UIF);
+}
+
+static void set_counter(void)
+{
+    sim_mem[0x530C] = (uint8_t)(now >> 8);
+    sim_mem[0x530D] = (uint8_t)now;
+}
+
+/* Moves time forward, wrapping the counter and serving the update ISR */
+static void advance(uint64_t to)
+{
+    while ((now >> 16) != (to >> 16))
+    {
+        now = (now | 0xFFFFu) + 1u;
+        R_SR1 |= TIM2_SR1_UIF;
+        if (!hold_update) update_isr();
+    }
+    now = to;
+    set_counter();
+}
+
+static void capture(uint8_t rising)
+{
+    uint16_t cnt = (uint16_t)now;
+
+    if (rising)
+    {
+        sim_mem[0x5313] = (uint8_t)(cnt >> 8);
+        sim_mem[0x5314] = (uint8_t)cnt;
+        R_SR1 |= TIM2_SR1_CC2IF;
+    }
+    else
+    {
+        sim_mem[0x5311] = (uint8_t)(cnt >> 8);
+        sim_mem[0x5312] = (uint8_t)cnt;
+        R_SR1 |= TIM2_SR1_CC1IF;
+    }
+}
+
+static void capture_isr(void)
+{
+    TIM2_CAP_COM_IRQHandler();
+    if (hold_update && (R_SR1 & TIM2_SR1_UIF)) update_isr();
+}
+
+/*
+ * One PWM cycle: rising edge, high for `high` ticks, falling edge, low
+ * for `low` ticks. The capture ISR runs `lat` ticks after each edge.
+ */
+static void pwm_cycle(uint64_t high, uint64_t low, uint64_t lat)
+{
+    uint64_t t0 = now;
+
+    capture(1);
+    advance(t0 + lat);
+    capture_isr();
+    advance(t0 + high);
+    capture(0);
+    advance(t0 + high + lat);
+    capture_isr();
+    advance(t0 + high + low);
+}
+
+/*
+ * Low phase counted from the previous falling edge, then a high phase
+ * ending in the falling edge that publishes the cycle
+ */
+static uint64_t fall_at;
+
+static void pwm_low_high(uint64_t low, uint64_t high, uint64_t lat)
+{
+    uint64_t t0 = fall_at + low;
+
+    advance(t0);
+    capture(1);
+    advance(t0 + lat);
+    capture_isr();
+    advance(t0 + high);
+    capture(0);
+    fall_at = now;
+    advance(t0 + high + lat);
+    capture_isr();
+}
+
+static void reset(void)
+{
+    sim_reset();
+    sim_on_access = tim2_access;
+    now = 0;
+    fall_at = 0;
+    hold_update = 0;
+    MHZ19_Init();
+    R_SR1 = 0;
+}
+
+/* ppm of a cycle by the datasheet formula, rounded */
+static unsigned ppm_ref(uint64_t high, uint64_t period)
+{
+    double ppm = 5000.0 * ((double)high - T_MS(2)) / ((double)period - T_MS(4));
+
+    return (unsigned)(ppm + 0.5);
+}
+
+/* ================= TESTS ================= */
+/* Cycles at the nominal period, starting at every phase of the 16-bit counter */
+static void test_wrap_phases(void)
+{
+    static const unsigned ppm[] = {0, 400, 1000, 2500, 5000};
+    uint64_t high, low;
+    unsigned i, phase;
+    int got, want, worst = 0;
+
+    for (phase = 0; phase < 0x10000u; phase += 0x0FF1u)
+        for (i = 0; i < sizeof(ppm) / sizeof(ppm[0]); i++)
+        {
+            reset();
+            advance(phase);
+            high = T_MS(2) + (uint64_t)ppm[i] * T_MS(1000) / 5000u;
+            low  = T_MS(1004) - high;
+
+            pwm_cycle(high, low, 3);
+            pwm_cycle(high, low, 3);
+            got  = MHZ19_GetPPM();
+            want = (int)ppm_ref(high, high + low);
+            if (got - want > worst)  worst = got - want;
+            if (want - got > worst)  worst = want - got;
+        }
+
+    printf("  nominal period, all counter phases: max error %d ppm\n", worst);
+    CHECK(worst <= 1);
+}
+
+/* Capture ISR after the counter wrapped, update ISR still pending */
+static void test_pending_uif(void)
+{
+    uint64_t high = T_MS(2) + T_MS(1000) * 800 / 5000;
+    uint64_t low  = T_MS(1004) - high;
+    uint64_t t0;
+
+    // second falling edge 20 ticks before a wrap, its ISR 40 ticks later
+    reset();
+    advance(0x50000u - 20u - high - (high + low));
+    pwm_cycle(high, low, 3);
+    t0 = now;
+    capture(1);
+    advance(t0 + 3);
+    capture_isr();
+    advance(t0 + high);
+    capture(0);
+    hold_update = 1;
+    advance(t0 + high + 40);
+    CHECK(R_SR1 & TIM2_SR1_UIF);
+    CHECK((uint16_t)now == 20);
+    capture_isr();
+    hold_update = 0;
+    advance(t0 + high + low);
+
+    CHECK(MHZ19_GetPPM() == ppm_ref(high, high + low));
+}
+
+/* Both edges pending in one capture ISR: the older one is taken first */
+static void test_both_pending(void)
+{
+    uint64_t high = T_MS(2) + 30;     /* 0 ppm, 2.12 ms high */
+    uint64_t low  = T_MS(1004) - high;
+    uint64_t t0;
+
+    reset();
+    pwm_cycle(high, low, 3);
+
+    t0 = now;
+    capture(1);
+    advance(t0 + high);
+    capture(0);
+    advance(t0 + high + 10);
+    capture_isr();
+    advance(t0 + high + low);
+
+    CHECK(MHZ19_GetPPM() == ppm_ref(high, high + low));
+}
+
+/* Glitches and off-spec periods are dropped, the last reading is kept */
+static void test_reject(void)
+{
+    uint64_t high = T_MS(2) + T_MS(1000) * 1200 / 5000;
+    uint64_t low  = T_MS(1004) - high;
+    unsigned ppm  = ppm_ref(high, high + low);
+
+    reset();
+    pwm_cycle(high, low, 3);
+    pwm_cycle(high, low, 3);
+    CHECK(MHZ19_GetPPM() == ppm);
+
+    // 100 us spike in the low phase
+    pwm_cycle(high, T_MS(300), 3);
+    pwm_cycle(25, low - T_MS(300) - 25, 3);
+    CHECK(MHZ19_GetPPM() == ppm);
+
+    // period 6 % long
+    pwm_cycle(high, low + T_MS(60), 3);
+    CHECK(MHZ19_GetPPM() == ppm);
+}
+
+/* 32-bit timebase wrap (every 2^32 ticks, ~4.8 h) in the middle of a cycle */
+static void test_timebase_wrap(void)
+{
+    uint64_t high = T_MS(2) + T_MS(1000) * 3000 / 5000;
+    uint64_t low  = T_MS(1004) - high;
+
+    reset();
+    advance(0x100000000ULL - high / 2);
+    pwm_cycle(high, low, 3);
+    pwm_cycle(high, low, 3);
+
+    CHECK(MHZ19_GetPPM() == ppm_ref(high, high + low));
+}
+
+#if !MHZ19_FILTER_LEN
+/*
+ * Unfiltered readings over the whole 0-5000 ppm range and every valid
+ * period (954-1054 ms), against the real-valued datasheet formula. The
+ * bands follow the deviation from the nominal 1004 ms: near it the
+ * multiply-and-shift path is used, beyond 2 % the exact divide.
+ */
+static void test_ppm_sweep(void)
+{
+    static const struct {
+        const char *name;
+        uint32_t    dev;        /* upper bound of |T - 1004 ms|, ticks */
+        double      max_err;    /* ppm */
+    } band[] = {
+        {"nominal",        0,    0.61},
+        {"+-0.5 %",        1255, 1.1},
+        {"+-2 % (fast)",   5000, 2.9},
+        {"beyond 2 % (exact)", 0xFFFFFFFFu, 1.0},
+    };
+    double err[4] = {0};
+    unsigned long n[4] = {0};
+    uint64_t period, high, x, dev;
+    unsigned b, ms;
+    double ref;
+    uint16_t got;
+
+    reset();
+    for (ms = 954; ms <= 1054; ms++)
+    {
+        period = T_MS(ms);
+        dev = period > T_MS(1004) ? period - T_MS(1004) : T_MS(1004) - period;
+        for (b = 0; dev > band[b].dev; b++) {}
+
+        for (x = 0; x <= period - T_MS(4); x += 97)
+        {
+            high = T_MS(2) + x;
+            pwm_low_high(period - high, high, 3);
+
+            got = MHZ19_GetPPM();
+            n[b]++;
+
+            ref = 5000.0 * (double)x / (double)(period - T_MS(4));
+            if (fabs(got - ref) > err[b]) err[b] = fabs(got - ref);
+        }
+    }
+
+    for (b = 0; b < 4; b++)
+    {
+        printf("  %-20s %6lu cycles, max error %.3f ppm\n",
+               band[b].name, n[b], err[b]);
+        CHECK(n[b] != 0 && err[b] <= band[b].max_err);
+    }
+}
+#endif
+
+#if MHZ19_FILTER_LEN
+/* Median of the last readings, then the EMA (alpha 1/4) */
+static void test_filter(void)
+{
+    uint64_t h800  = T_MS(2) + T_MS(1000) * 800 / 5000;
+    uint64_t h3000 = T_MS(2) + T_MS(1000) * 3000 / 5000;
+    uint64_t h1600 = T_MS(2) + T_MS(1000) * 1600 / 5000;
+    unsigned i;
+    unsigned ppm;
+
+    reset();
+    for (i = 0; i < MHZ19_FILTER_LEN + 1u; i++)
+        pwm_cycle(h800, T_MS(1004) - h800, 3);
+    CHECK(MHZ19_GetPPM() == 800);
+
+    // one valid but outlying cycle: the median drops it
+    pwm_cycle(h3000, T_MS(1004) - h3000, 3);
+    CHECK(MHZ19_GetPPM() == 800);
+    pwm_cycle(h800, T_MS(1004) - h800, 3);
+    CHECK(MHZ19_GetPPM() == 800);
+
+    // step to 1600 ppm: the median follows after half the window, the EMA lags
+    for (i = 0; i < MHZ19_FILTER_LEN / 2u + 1u; i++)
+    {
+        pwm_cycle(h1600, T_MS(1004) - h1600, 3);
+        ppm = MHZ19_GetPPM();
+    }
+    CHECK(ppm > 800 && ppm < 1600);
+    for (i = 0; i < 40; i++)
+    {
+        pwm_cycle(h1600, T_MS(1004) - h1600, 3);
+        ppm = MHZ19_GetPPM();
+    }
+    printf("  filter: 800 -> 1600 ppm step, %u ppm after %u cycles\n",
+           ppm, MHZ19_FILTER_LEN / 2u + 41u);
+    CHECK(ppm >= 1598 && ppm <= 1600);
+}
+#endif
+
+int main(void)
+{
+    test_wrap_phases();
+    test_pending_uif();
+    test_both_pending();
+    test_reject();
+    test_timebase_wrap();
+#if MHZ19_FILTER_LEN
+    test_filter();
+#else
+    test_ppm_sweep();
+#endif
+
+    printf("%s\n", sim_failures ? "FAILED" : "OK");
+    return sim_failures != 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * MH-Z19B UART backend (mh-z19b_uart.c, MHZ19_BACKEND_UART) against a
+ * simulated sensor.
+ *
+ * UART1 is replaced by stubs: UART1_SendChar() collects the request
+ * frames, the RX handler registered by MHZ19_Init() is fed the sensor's
+ * bytes directly, as the RX interrupt would. power_lock() and
+ * power_unlock() keep the lock mask so the test can see when halt and
+ * clock scaling would be blocked; millis() is a variable.
+ */
+#include <string.h>
+#include "mh-z19b.h"
+#include "uart_driver.h"
+#include "clock.h"
+#include "power.h"
+#include "systick.h"
+
+/* ================= STUBS ================= */
+static uart1_rx_handler_t rx;
+static uint8_t  locks;
+static uint32_t now_ms;
+
+static uint8_t  req[9];
+static uint8_t  req_len;
+static unsigned requests;
+
+void UART1_Init(unsigned long f_cpu, unsigned long baudrate) { (void)f_cpu; (void)baudrate; }
+void UART1_SetRxHandler(uart1_rx_handler_t handler) { rx = handler; }
+
+void UART1_SendChar(char c)
+{
+    req[req_len++] = (uint8_t)c;
+    if (req_len == sizeof(req))
+    {
+        req_len = 0;
+        requests++;
+    }
+}
+
+uint32_t clock_hz(void) { return 16000000UL; }
+void power_lock(uint8_t mask) { locks |= mask; }
+void power_unlock(uint8_t mask) { locks &= (uint8_t)~mask; }
+uint32_t millis(void) { return now_ms; }
+
+/* ================= SENSOR ================= */
+/* Sends a read reply; `bad_sum` corrupts the checksum */
+static void sensor_reply(uint16_t ppm, uint8_t bad_sum)
+{
+    uint8_t f[9] = {0xFF, 0x86, 0, 0, 0x41, 0, 0, 0, 0};
+    uint8_t sum = 0;
+    uint8_t i;
+
+    f[2] = (uint8_t)(ppm >> 8);
+    f[3] = (uint8_t)ppm;
+    for (i = 1; i < 8; i++) sum += f[i];
+    f[8] = (uint8_t)(~sum + 1u + bad_sum);
+
+    for (i = 0; i < 9; i++) rx(f[i], 0);
+}
+
+/* ================= TESTS ================= */
+static void test_request_reply(void)
+{
+    static const uint8_t read_cmd[9] = {0xFF, 0x01, 0x86, 0, 0, 0, 0, 0, 0x79};
+
+    MHZ19_Init();
+    CHECK(rx != 0);
+
+    // first call: nothing received yet, request sent, halt blocked
+    CHECK(MHZ19_GetPPM() == 0);
+    CHECK(requests == 1 && memcmp(req, read_cmd, 9) == 0);
+    CHECK(locks & POWER_LOCK_UART);
+
+    sensor_reply(612, 0);
+    CHECK(!(locks & POWER_LOCK_UART));
+    CHECK(MHZ19_GetPPM() == 612);
+    CHECK(MHZ19_GetTimeouts() == 0 && MHZ19_GetFrameErrors() == 0);
+}
+
+/* Bytes before the start byte are skipped */
+static void test_resync(void)
+{
+    rx(0x12, 0);
+    rx(0x86, 0);
+    rx(0x00, 0);
+    sensor_reply(745, 0);
+    CHECK(!(locks & POWER_LOCK_UART));
+    CHECK(MHZ19_GetPPM() == 745);
+    CHECK(MHZ19_GetFrameErrors() == 0);
+}
+
+/* A corrupted frame or a receive error is counted and the reading kept */
+static void test_bad_frame(void)
+{
+    sensor_reply(999, 1);
+    CHECK(!(locks & POWER_LOCK_UART));
+    CHECK(MHZ19_GetFrameErrors() == 1);
+    CHECK(MHZ19_GetPPM() == 745);
+
+    // framing error in the middle of a frame: the rest is not joined to the next reply
+    rx(0xFF, 0);
+    rx(0x86, 0);
+    rx(0x03, 1);
+    CHECK(MHZ19_GetFrameErrors() == 2);
+    CHECK(!(locks & POWER_LOCK_UART));
+    sensor_reply(801, 0);
+    CHECK(MHZ19_GetPPM() == 801);
+}
+
+/* No reply: the lock is released at the deadline, a partial frame dropped */
+static void test_timeout(void)
+{
+    unsigned sent = requests;
+
+    // half a reply, then silence
+    rx(0xFF, 0);
+    rx(0x86, 0);
+    rx(0x02, 0);
+    now_ms += MHZ19_REPLY_TIMEOUT_MS - 1u;
+    MHZ19_Poll();
+    CHECK(locks & POWER_LOCK_UART);
+    CHECK(MHZ19_GetTimeouts() == 0);
+
+    now_ms += 1u;
+    MHZ19_Poll();
+    CHECK(!(locks & POWER_LOCK_UART));
+    CHECK(MHZ19_GetTimeouts() == 1);
+
+    // the next request gets a complete reply
+    CHECK(MHZ19_GetPPM() == 801);
+    CHECK(requests == sent + 1u && (locks & POWER_LOCK_UART));
+    sensor_reply(650, 0);
+    CHECK(MHZ19_GetPPM() == 650);
+
+    // previous request unanswered: given up by the next MHZ19_GetPPM()
+    CHECK(MHZ19_GetTimeouts() == 1);
+    CHECK(MHZ19_GetPPM() == 650);
+    CHECK(MHZ19_GetTimeouts() == 2);
+    CHECK(locks & POWER_LOCK_UART);
+
+    // deadline across the millis() wrap
+    now_ms = 0xFFFFFFFFu - 10u;
+    CHECK(MHZ19_GetPPM() == 650);
+    now_ms += 50u;
+    MHZ19_Poll();
+    CHECK(locks & POWER_LOCK_UART);
+    now_ms += 50u;
+    MHZ19_Poll();
+    CHECK(!(locks & POWER_LOCK_UART));
+    CHECK(MHZ19_GetTimeouts() == 4);
+}
+
+int main(void)
+{
+    test_request_reply();
+    test_resync();
+    test_bad_frame();
+    test_timeout();
+
+    printf("%s\n", sim_failures ? "FAILED" : "OK");
+    return sim_failures != 0;
+}
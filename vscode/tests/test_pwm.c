@@ -0,0 +1,80 @@
+/*
+ * Buzzer (pwm.c) over the TIM1 PWM driver: the duty given in per mille
+ * keeps its share of the period whatever ARR the frequency needs.
+ *
+ * TIM1 is the simulated register file; the compare value is read back
+ * from CCR4 and the period from ARR. millis() is a variable.
+ */
+#include "pwm.h"
+#include "tim1_driver.h"
+#include "clock.h"
+#include "systick.h"
+
+/* ================= STUBS ================= */
+static uint32_t now_ms;
+
+uint32_t clock_hz(void) { return 16000000UL; }
+uint32_t millis(void) { return now_ms; }
+
+/* ================= TIM1 ================= */
+static uint16_t arr(void)  { return (uint16_t)((TIM1_ARRH << 8) | TIM1_ARRL); }
+static uint16_t ccr4(void) { return (uint16_t)((TIM1_CCR4H << 8) | TIM1_CCR4L); }
+
+/* ================= TESTS ================= */
+/* Silent until the first ON phase, then the requested share of the new period */
+static void test_duty_after_frequency(void)
+{
+    sim_reset();
+    Buzzer_Init(4, 1000, 3);
+    CHECK(arr() == 1000 && ccr4() == 0);
+
+    // 2 kHz at 16 MHz: ARR = 7999, not the 1000 of Buzzer_Init()
+    Buzzer_Start(2000, 500, 200, 800);
+    CHECK(arr() == 7999);
+    CHECK(ccr4() == 0);
+    CHECK(TIM1_CR1 & 0x01);
+
+    now_ms += 800;
+    Buzzer_Update();
+    CHECK(ccr4() == 4000);          /* 50 % of 8000 counts */
+
+    now_ms += 200;
+    Buzzer_Update();
+    CHECK(ccr4() == 0);
+
+    // another frequency, another period: same share
+    Buzzer_Start(500, 250, 200, 800);
+    CHECK(arr() == 31999);
+    now_ms += 800;
+    Buzzer_Update();
+    CHECK(ccr4() == 8000);          /* 25 % of 32000 counts */
+
+    Buzzer_Stop();
+    CHECK(ccr4() == 0 && !(TIM1_CR1 & 0x01));
+}
+
+/* Per-mille limits and rounding */
+static void test_permille(void)
+{
+    sim_reset();
+    TIM1_InitPWM(4, 999, 0);
+    TIM1_PWM_SetDutyPermille(4, 0);
+    CHECK(ccr4() == 0);
+    TIM1_PWM_SetDutyPermille(4, 333);
+    CHECK(ccr4() == 333);
+    TIM1_PWM_SetDutyPermille(4, 2000);
+    CHECK(ccr4() == arr());
+
+    TIM1_InitPWM(4, 2, 0);          /* 3 counts */
+    TIM1_PWM_SetDutyPermille(4, 500);
+    CHECK(ccr4() == 2);             /* 1.5 rounded up */
+}
+
+int main(void)
+{
+    test_duty_after_frequency();
+    test_permille();
+
+    printf("%s\n", sim_failures ? "FAILED" : "OK");
+    return sim_failures != 0;
+}